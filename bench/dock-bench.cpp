@@ -0,0 +1,305 @@
+/**
+ * Shader Dock render benchmark
+ *
+ * Draws synthetic docks with the plugin's DockRenderer into an offscreen
+ * output of a surfaceless EGL context, no compositor needed: 1, 10 and 100
+ * icons, icon sizes from 24 to 256 px, output scales 1 and 2, each idle
+ * (the dock cache composited) and animated (every effect live, with the
+ * magnification lens sweeping along the dock). Reports
+ * icon loading time, CPU and GPU frame times, draw calls and heap
+ * allocations per frame. The frame path has to do without the heap: any
+ * allocation in a measured frame fails the benchmark. That covers
+ * DockRenderer::render() and the RollingStat bookkeeping of a frame, not
+ * the plugin's calls into the compositor around them.
+ *
+ * Usage: dock-bench [frames per scenario]
+ */
+
+#include "dock-renderer.hpp"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+// Every heap allocation of the process, to catch them in the frame path
+static std::atomic<size_t> allocations{0};
+
+// Not inlined, or GCC pairs the malloc() and free() inside with the
+// operator delete and new of the caller, and warns about a mismatch
+[[gnu::noinline]] void* operator new(size_t size)
+{
+    allocations++;
+    if (void *ptr = std::malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+[[gnu::noinline]] void operator delete(void *ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+namespace
+{
+
+using namespace shader_dock;
+
+// The output the docks are laid out on, in logical pixels
+constexpr int output_width = 1920;
+constexpr int output_height = 1080;
+constexpr int spacing = 8;
+constexpr int margin = 8;
+constexpr float corner_radius = 12.0f;
+constexpr int warmup_frames = 10;
+constexpr float magnification = 2.0f;
+constexpr float magnification_radius = 2.5f;
+// Frames the lens takes to sweep the dock and back
+constexpr int lens_sweep_frames = 120;
+
+struct Scenario
+{
+    int icons;
+    int icon_size;
+    float scale;
+    bool animated;
+};
+
+/** A surfaceless GLES 3 context, made current. */
+bool make_context()
+{
+    auto get_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (!get_display) return false;
+    EGLDisplay display = get_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) return false;
+    if (!eglBindAPI(EGL_OPENGL_ES_API)) return false;
+
+    EGLint attribs[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_NONE};
+    EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attribs);
+    return context != EGL_NO_CONTEXT && eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+}
+
+/**
+ * An offscreen output. Scissor boxes map to pixels the way they do on
+ * Wayfire's output targets, see DockLayout::mirrored().
+ */
+class BenchTarget : public DockTarget
+{
+  public:
+    BenchTarget(float output_scale)
+    {
+        geometry = {0, 0, output_width, output_height};
+        scale = output_scale;
+        buffer.allocate((int)std::ceil(output_width * scale), (int)std::ceil(output_height * scale));
+    }
+
+    ~BenchTarget()
+    {
+        buffer.release();
+    }
+
+    void bind() const override
+    {
+        buffer.bind();
+    }
+
+    void scissor(const wlr_box& box) const override
+    {
+        glEnable(GL_SCISSOR_TEST);
+        glScissor((int)((box.x - geometry.x) * scale), (int)((box.y - geometry.y) * scale),
+                  (int)(box.width * scale), (int)(box.height * scale));
+    }
+
+  private:
+    CacheBuffer buffer;
+};
+
+/** The dock's layout on the output, as the plugin computes it. */
+DockLayout make_layout(int icons, int icon_size)
+{
+    DockLayout layout;
+    layout.count = icons;
+    layout.icon_size = icon_size;
+    layout.spacing = spacing;
+    layout.margin = margin;
+    int content_height = icons * icon_size + (icons - 1) * spacing + margin * 2;
+    int height = std::min(content_height, std::max(output_height - margin * 2, icon_size + margin * 2));
+    layout.dock = {margin, (output_height - height) / 2, icon_size + margin * 2, height};
+    return layout;
+}
+
+/** A round icon in its own hue, big enough to be scaled down to every size. */
+std::vector<uint8_t> make_source_image(int index, int size)
+{
+    std::vector<uint8_t> pixels(size * size * 4);
+    float hue = index * 0.618034f;
+    float half = size * 0.5f;
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            float d = std::hypot(x + 0.5f - half, y + 0.5f - half) / half;
+            uint8_t *px = &pixels[(y * size + x) * 4];
+            px[0] = (uint8_t)(127.5f + 127.5f * std::cos(6.2831853f * hue));
+            px[1] = (uint8_t)(127.5f + 127.5f * std::cos(6.2831853f * (hue + 0.333f)));
+            px[2] = (uint8_t)(255.0f * (1.0f - d * 0.5f) * (d < 1.0f));
+            px[3] = (uint8_t)(255.0f * std::clamp((1.0f - d) * half, 0.0f, 1.0f));
+        }
+    }
+    return pixels;
+}
+
+/**
+ * Load @icons images into @atlas the way the plugin does: scale each
+ * source to @texels pixels, then upload it. Returns the time it took in ms.
+ */
+float load_icons(std::vector<DockIcon>& icons, IconAtlas& atlas, int texels)
+{
+    constexpr int source_size = 512;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < icons.size(); i++) {
+        auto source = make_source_image(i, source_size);
+        std::vector<uint8_t> scaled;
+        int width = source_size, height = source_size;
+        const uint8_t *pixels = source.data();
+        if (scale_icon_image(source.data(), source_size, source_size, texels, scaled, width, height))
+            pixels = scaled.data();
+
+        auto& icon = icons[i];
+        icon.texture_size = texels;
+        if (!atlas.allocate(width, height, icon.atlas_rect)) {
+            icon.state = IconState::Failed;
+            continue;
+        }
+        atlas.upload(pixels, icon.atlas_rect);
+        icon.state = IconState::Ready;
+        icon.running = i % 3 == 0;
+    }
+    atlas.update_mipmaps();
+    glFinish();
+    return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/** Run @scenario for @frames measured frames, false if any of them allocated. */
+bool run(DockPrograms& programs, const Scenario& scenario, int frames)
+{
+    auto shaders = programs.get(RenderQuality::Full);
+    BenchTarget target(scenario.scale);
+    int texels = (int)std::ceil(scenario.icon_size * scenario.scale);
+
+    // Animated docks load the icons for the lens, as the plugin does
+    float grown = scenario.animated ? magnification : 1.0f;
+    std::vector<DockIcon> icons(scenario.icons);
+    IconAtlas atlas;
+    float load_ms = load_icons(icons, atlas, (int)std::ceil(scenario.icon_size * grown * scenario.scale));
+
+    DockScene scene;
+    scene.layout = make_layout(scenario.icons, scenario.icon_size);
+    scene.icons = icons.data();
+    scene.atlas = &atlas;
+    scene.bevel_mask = &programs.bevel_mask(texels, scenario.icon_size, corner_radius);
+    scene.corner_radius = corner_radius;
+    scene.shimmer = scenario.animated;
+    scene.hue_border = scenario.animated;
+    // The whole dock every frame: it animates, or something below changed.
+    // Grown icons reach out of it.
+    auto dock = scene.layout.dock;
+    if (scenario.animated) dock.width = scene.layout.lens_reach(magnification - 1.0f) - dock.x;
+    std::vector<wlr_box> damage = {dock};
+
+    DockRenderer renderer;
+    renderer.init(icons.size());
+    RollingStat cpu_ms, frame_ms, gpu_ms, draw_calls;
+    size_t frame_allocations = 0;
+    // A whole lens sweep warms up animated docks: the driver builds some
+    // shader variants the first time a grown icon reaches a new spot
+    int warmup = scenario.animated ? lens_sweep_frames : warmup_frames;
+    for (int frame = 0; frame < warmup + frames; frame++) {
+        bool measured = frame >= warmup;
+        if (scenario.animated) {
+            scene.time = frame / 60.0f;
+            icons[frame / 30 % icons.size()].hover = 0.5f + 0.5f * std::sin(frame * 0.2f);
+            float sweep = 0.5f - 0.5f * std::cos(6.2831853f * frame / lens_sweep_frames);
+            scene.lens = {dock.y + dock.height * sweep, magnification - 1.0f,
+                          magnification_radius * (scenario.icon_size + spacing)};
+        }
+
+        target.bind();
+        glDisable(GL_SCISSOR_TEST);
+        glClearColor(0.2f, 0.3f, 0.4f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        size_t before = allocations;
+        auto start = std::chrono::steady_clock::now();
+        renderer.render(*shaders, scene, target, damage, measured);
+        auto submitted = std::chrono::steady_clock::now();
+        glFinish();
+        auto finished = std::chrono::steady_clock::now();
+
+        // The stats, as the plugin keeps them every frame
+        DockRenderer::reset_gl_state();
+        renderer.pass_timer.collect([&] (const float *ms) {
+            gpu_ms.push(ms[PassTimer::Background] + ms[PassTimer::Icons]);
+        });
+        if (!measured) continue;
+        cpu_ms.push(std::chrono::duration<float, std::milli>(submitted - start).count());
+        frame_ms.push(std::chrono::duration<float, std::milli>(finished - start).count());
+        draw_calls.push(renderer.draw_calls);
+        frame_allocations += allocations - before;
+    }
+    renderer.destroy();
+    atlas.destroy();
+
+    printf("%5d %5d %4.0fx %-8s | %9.2f | %8.3f %8.3f | %9.3f %9.3f | %8.3f %8.3f | %5.0f | %6.2f\n",
+           scenario.icons, scenario.icon_size, scenario.scale, scenario.animated ? "animated" : "idle",
+           load_ms, cpu_ms.percentile(0.5f), cpu_ms.percentile(0.95f),
+           frame_ms.percentile(0.5f), frame_ms.percentile(0.95f),
+           gpu_ms.percentile(0.5f), gpu_ms.percentile(0.95f),
+           draw_calls.percentile(0.5f), (float)frame_allocations / frames);
+    return frame_allocations == 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    int frames = argc > 1 ? std::max(1, atoi(argv[1])) : (int)RollingStat::window;
+    if (!make_context()) {
+        fprintf(stderr, "dock-bench: no surfaceless EGL context with GLES 3\n");
+        return 1;
+    }
+
+    // Program binaries go to a scratch cache, not the user's
+    char cache_dir[] = "/tmp/dock-bench-XXXXXX";
+    if (!mkdtemp(cache_dir)) return 1;
+    setenv("XDG_CACHE_HOME", cache_dir, 1);
+
+    printf("renderer: %s, %d frames per scenario, times in ms\n", (const char*)glGetString(GL_RENDERER), frames);
+    printf("icons  size scale mode     |   load ms |  cpu p50  cpu p95 | frame p50 frame p95 |  gpu p50  gpu p95 | draws | allocs\n");
+
+    int status = 0;
+    {
+        DockPrograms programs;
+        if (!programs.get(RenderQuality::Full)) {
+            fprintf(stderr, "dock-bench: the dock's shaders failed to build\n");
+            status = 1;
+        } else {
+            for (bool animated : {false, true})
+                for (float scale : {1.0f, 2.0f})
+                    for (int icon_size : {24, 48, 64, 128, 256})
+                        for (int icons : {1, 10, 100})
+                            if (!run(programs, {icons, icon_size, scale, animated}, frames)) status = 1;
+            if (status) fprintf(stderr, "dock-bench: the frame path allocated\n");
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::remove_all(cache_dir, ec);
+    return status;
+}
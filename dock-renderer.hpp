@@ -0,0 +1,2248 @@
+/**
+ * Shader Dock renderer
+ *
+ * The compositor independent part of the dock: shader programs, icon
+ * images and the icon atlas, and the draws of a dock. Everything here only
+ * needs a current GLES 3 context, so that the plugin and the headless
+ * benchmark in bench/ share it, and the checks in tests/ cover it.
+ */
+
+#pragma once
+
+#include <GLES3/gl3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <wayfire/util/log.hpp>
+
+extern "C"
+{
+#include <wlr/util/box.h>
+}
+
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <thread>
+#include <cstring>
+#include <cinttypes>
+#include <climits>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <cmath>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <png.h>
+
+namespace shader_dock
+{
+
+// ============================================================================
+// Shader Sources
+// ============================================================================
+
+static const char* vertex_shader_src = R"(#version 300 es
+precision highp float;
+layout(location = 0) in vec2 a_position;
+layout(location = 1) in vec2 a_texcoord;
+out vec2 v_texcoord;
+uniform mat4 u_mvp;
+void main() {
+    gl_Position = u_mvp * vec4(a_position, 0.0, 1.0);
+    v_texcoord = a_texcoord;
+}
+)";
+
+// Icons are drawn instanced: the unit quad is placed and sized per icon,
+// and the icon's hover value and atlas rect come from the instance buffer.
+static const char* icon_vertex_shader_src = R"(#version 300 es
+precision highp float;
+layout(location = 0) in vec2 a_position;
+layout(location = 1) in vec2 a_texcoord;
+layout(location = 2) in vec2 a_offset;
+layout(location = 3) in float a_hover;
+layout(location = 4) in vec4 a_atlas_rect;
+// Growth under the magnification lens, 1 outside of it
+layout(location = 6) in float a_scale;
+out vec2 v_texcoord;
+flat out float v_hover;
+flat out vec4 v_atlas_rect;
+uniform mat4 u_mvp;
+uniform vec2 iResolution;
+void main() {
+    gl_Position = u_mvp * vec4(a_offset + a_position * iResolution * a_scale, 0.0, 1.0);
+    v_texcoord = a_texcoord;
+    v_hover = a_hover;
+    v_atlas_rect = a_atlas_rect;
+}
+)";
+
+static const char* icon_fragment_shader_src = R"(#version 300 es
+precision highp float;
+in vec2 v_texcoord;
+flat in float v_hover;
+flat in vec4 v_atlas_rect;
+out vec4 frag_color;
+
+uniform sampler2D u_texture;
+// The static terms of the bevel, baked by BevelMask
+uniform sampler2D u_bevel_shading;
+uniform sampler2D u_bevel_distance;
+uniform vec2 iResolution;
+uniform vec4 bevelColor;
+#ifdef QUALITY_FULL
+uniform float time;
+uniform float shimmerTime;
+// cos and sin of the highlight's rotation, shimmerTime * 2.5
+uniform vec2 highlightPhase;
+#else
+// Frozen at the start, so that nothing depends on time
+const float time = 0.0;
+const float shimmerTime = 0.0;
+const vec2 highlightPhase = vec2(1.0, 0.0);
+#endif
+
+const float bevelWidth = 12.0;
+const float aa = 1.5;
+// Drawn in place of icons whose image is still being decoded
+const vec4 placeholderColor = vec4(0.5, 0.5, 0.5, 0.35);
+
+void main() {
+    float hover = v_hover;
+    float bounce = 1.0 + hover * (sin(time * 6.0) * 0.05 + 0.08);
+    
+    // The bounced box is the unbounced one scaled up, and so is its distance
+    vec2 p = (v_texcoord - 0.5) * iResolution;
+    vec2 bounce_uv = (v_texcoord - 0.5) / bounce + 0.5;
+    float d = texture(u_bevel_distance, bounce_uv).r * bounce;
+    float shape_alpha = 1.0 - smoothstep(-aa, aa, d);
+    
+    vec2 scaled_uv = clamp(bounce_uv, 0.0, 1.0);
+    vec4 tex_color = v_atlas_rect.z > 0.0 ?
+        texture(u_texture, v_atlas_rect.xy + scaled_uv * v_atlas_rect.zw) : placeholderColor;
+    
+#ifdef QUALITY_OFF
+    frag_color = vec4(tex_color.rgb, tex_color.a * shape_alpha);
+#else
+    float bevel_intensity = smoothstep(-bevelWidth, 0.0, d) - smoothstep(0.0, aa, d);
+    
+    float center_distance = length(p) / (min(iResolution.x, iResolution.y) * 0.5);
+    vec4 shading = texture(u_bevel_shading, v_texcoord);
+    float button_height = shading.r;
+    float button_lighting = shading.g;
+    
+    float combined_bevel = max(bevel_intensity, button_height * 0.4);
+    // sin(angle * 2.0 - shimmerTime * 2.5), raised to the 8th power
+    float highlight = (shading.b * highlightPhase.x - shading.a * highlightPhase.y) * 0.5 + 0.5;
+    highlight *= highlight;
+    highlight *= highlight;
+    float highlight_factor = highlight * highlight;
+    float brightness = (0.7 + highlight_factor * 0.6) * button_lighting;
+    
+    float shimmer = sin((p.x + p.y) / (iResolution.x + iResolution.y) * 8.0 + shimmerTime * 4.0);
+    float shimmer_intensity = smoothstep(0.6, 1.0, shimmer) * 0.3 * 
+                              smoothstep(-bevelWidth * 0.5, bevelWidth * 0.5, -abs(d));
+    
+    vec3 bevel_col = mix(bevelColor.rgb * brightness, vec3(1.0, 1.0, 0.9), shimmer_intensity);
+    vec3 final_rgb = mix(tex_color.rgb, bevel_col, combined_bevel * bevelColor.a);
+    final_rgb += vec3(0.2, 0.15, 0.1) * hover * (1.0 - center_distance);
+    
+    frag_color = vec4(final_rgb, tex_color.a * shape_alpha);
+#endif
+}
+)";
+
+static const char* background_fragment_shader_src = R"(#version 300 es
+precision highp float;
+in vec2 v_texcoord;
+out vec4 frag_color;
+
+uniform vec2 iResolution;
+uniform float cornerRadius;
+uniform vec4 backgroundColor;
+#ifdef QUALITY_FULL
+uniform float time;
+#else
+const float time = 0.0;
+#endif
+
+float sdRoundedBox(vec2 p, vec2 b, float r) {
+    vec2 q = abs(p) - b + r;
+    return min(max(q.x, q.y), 0.0) + length(max(q, 0.0)) - r;
+}
+
+vec3 hsv2rgb(vec3 c) {
+    vec4 K = vec4(1.0, 2.0 / 3.0, 1.0 / 3.0, 3.0);
+    vec3 p = abs(fract(c.xxx + K.xyz) * 6.0 - K.www);
+    return c.z * mix(K.xxx, clamp(p - K.xxx, 0.0, 1.0), c.y);
+}
+
+void main() {
+    vec2 p = (v_texcoord - 0.5) * iResolution;
+    float d = sdRoundedBox(p, iResolution * 0.5, cornerRadius);
+    
+    float aa = 1.5;
+    float shape_alpha = 1.0 - smoothstep(-aa, aa, d);
+#ifdef QUALITY_OFF
+    frag_color = vec4(backgroundColor.rgb, backgroundColor.a * shape_alpha);
+#else
+    float border = smoothstep(-3.0, 0.0, d) - smoothstep(0.0, aa, d);
+    
+    float hue = fract((v_texcoord.x + v_texcoord.y) * 0.5 - time * 0.1);
+    vec3 border_color = hsv2rgb(vec3(hue, 0.8, 1.0));
+    
+    vec3 final_color = mix(backgroundColor.rgb, border_color, border * 0.8);
+    frag_color = vec4(final_color, backgroundColor.a * shape_alpha);
+#endif
+}
+)";
+
+// Running indicators: a dot in the margin left of the icon of each running
+// app, drawn from the icon instances. The other instances collapse to nothing.
+static const char* indicator_vertex_shader_src = R"(#version 300 es
+precision highp float;
+layout(location = 0) in vec2 a_position;
+layout(location = 2) in vec2 a_offset;
+layout(location = 5) in float a_running;
+layout(location = 6) in float a_scale;
+out vec2 v_texcoord;
+uniform mat4 u_mvp;
+// Dot center relative to the icon at rest, and its radius
+uniform vec3 indicator;
+void main() {
+    float size = a_running > 0.0 ? indicator.z * 2.0 : 0.0;
+    vec2 corner = a_offset + vec2(indicator.x, indicator.y * a_scale) - indicator.z;
+    gl_Position = u_mvp * vec4(corner + a_position * size, 0.0, 1.0);
+    v_texcoord = a_position;
+}
+)";
+
+static const char* indicator_fragment_shader_src = R"(#version 300 es
+precision highp float;
+in vec2 v_texcoord;
+out vec4 frag_color;
+uniform vec3 indicator;
+const vec4 indicatorColor = vec4(0.9, 0.9, 0.9, 0.9);
+void main() {
+    // Distance to the edge of the dot, in pixels
+    float d = (length(v_texcoord - 0.5) * 2.0 - 1.0) * indicator.z;
+    frag_color = vec4(indicatorColor.rgb, indicatorColor.a * (1.0 - smoothstep(-1.0, 0.0, d)));
+}
+)";
+
+// The frame cost overlay: GPU time of the last frames as bars, as parts of
+// stats_overlay_scale of the refresh interval
+static constexpr int stats_overlay_samples = 64;
+static constexpr float stats_overlay_scale = 0.25f;
+
+static const char* stats_fragment_shader_src = R"(#version 300 es
+precision highp float;
+in vec2 v_texcoord;
+out vec4 frag_color;
+uniform float samples[64];
+void main() {
+    float value = samples[min(int(v_texcoord.x * 64.0), 63)];
+    vec3 bar = mix(vec3(0.2, 0.8, 0.3), vec3(0.9, 0.2, 0.2), clamp(value, 0.0, 1.0));
+    frag_color = 1.0 - v_texcoord.y < value ? vec4(bar, 0.9) : vec4(0.0, 0.0, 0.0, 0.5);
+}
+)";
+
+// Composites the dock cache, which holds premultiplied colors
+static const char* cache_fragment_shader_src = R"(#version 300 es
+precision highp float;
+in vec2 v_texcoord;
+out vec4 frag_color;
+uniform sampler2D u_texture;
+void main() {
+    frag_color = texture(u_texture, v_texcoord);
+}
+)";
+
+// ============================================================================
+// Cache Files
+// ============================================================================
+
+/** A read-only file mapping, unmapped when dropped. */
+struct MappedFile
+{
+    void *base = MAP_FAILED;
+    size_t length = 0;
+
+    const uint8_t *bytes() const { return (const uint8_t*)base; }
+
+    ~MappedFile()
+    {
+        if (base != MAP_FAILED) munmap(base, length);
+    }
+};
+
+/** Map @path, or return nullptr. @populate prefaults all pages. */
+inline std::shared_ptr<MappedFile> map_file(const std::string& path, bool populate)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+
+    struct stat st;
+    auto file = std::make_shared<MappedFile>();
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        file->length = st.st_size;
+        file->base = mmap(nullptr, file->length, PROT_READ,
+                          MAP_PRIVATE | (populate ? MAP_POPULATE : 0), fd, 0);
+    }
+    close(fd);
+    return file->base == MAP_FAILED ? nullptr : file;
+}
+
+inline std::string cache_base_dir()
+{
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    if (xdg && *xdg) return std::string(xdg) + "/shader-dock";
+    const char *home = getenv("HOME");
+    return std::string(home ? home : "/tmp") + "/.cache/shader-dock";
+}
+
+/** FNV-1a over a cache key, used to name cache files. */
+struct CacheKey
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    void mix(const void *data, size_t len)
+    {
+        for (size_t i = 0; i < len; i++) {
+            hash ^= ((const uint8_t*)data)[i];
+            hash *= 0x100000001b3ull;
+        }
+    }
+
+    void mix(const char *str)
+    {
+        mix(str, std::strlen(str) + 1);
+    }
+
+    std::string hex() const
+    {
+        char name[17];
+        snprintf(name, sizeof(name), "%016" PRIx64, hash);
+        return name;
+    }
+};
+
+/**
+ * Write @chunks to @path. The data goes to a private name first and is then
+ * renamed into place, so readers never see a partial file.
+ */
+inline bool write_cache_file(const std::string& path, std::initializer_list<std::pair<const void*, size_t>> chunks)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+    if (ec) return false;
+
+    std::ostringstream tmp_name;
+    tmp_name << path << ".tmp." << getpid() << "." << std::this_thread::get_id();
+    std::ofstream file(tmp_name.str(), std::ios::binary | std::ios::trunc);
+    for (const auto& [data, len] : chunks)
+        file.write((const char*)data, len);
+    file.close();
+
+    if (!file || rename(tmp_name.str().c_str(), path.c_str()) != 0) {
+        unlink(tmp_name.str().c_str());
+        return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// Structures
+// ============================================================================
+
+struct AtlasRect
+{
+    int x = 0, y = 0, width = 0, height = 0;
+};
+
+/** Shader variants, from the full effects down to plain rounded quads. */
+enum class RenderQuality
+{
+    Full,    // everything, including the effects that animate over time
+    Static,  // the same look frozen in time, needs no animation frames
+    Off,     // textured rounded quads without bevel or border
+};
+
+inline const char* quality_defines(RenderQuality quality)
+{
+    switch (quality) {
+      case RenderQuality::Full:   return "#define QUALITY_FULL\n";
+      case RenderQuality::Static: return "#define QUALITY_STATIC\n";
+      case RenderQuality::Off:    return "#define QUALITY_OFF\n";
+    }
+    return "";
+}
+
+enum class IconState
+{
+    Unloaded,  // no reference to the shared atlas yet
+    Loading,   // decoding in the background, drawn as a placeholder
+    Ready,
+    Failed,
+};
+
+struct DockIcon
+{
+    std::string app_id;
+    std::string name;
+    std::string exec;               // shell command, for Exec lines that need one
+    std::vector<std::string> argv;  // Exec split into arguments, when it does not
+    std::string icon_name;          // Icon= of the desktop entry
+    std::string icon_path;          // icon_name resolved for the pixel size
+    float hover = 0.0f;
+    int running = 0;  // mapped toplevel views of the app
+    IconState state = IconState::Unloaded;
+    int texture_size = 0;  // pixel size the atlas copy was scaled to
+    AtlasRect atlas_rect;
+};
+
+/**
+ * Split an (unescaped) Exec value into arguments the way the desktop entry
+ * spec says: arguments are separated by spaces, may be double quoted, and
+ * inside quotes ", `, $ and \ are escaped with a backslash. Field codes are
+ * expanded for a launch without files: %f %F %u %U and the deprecated ones
+ * vanish, %i becomes --icon <Icon>, %c the name and %k the desktop file.
+ *
+ * Returns false for values that need a shell after all, that is reserved
+ * characters outside of quotes, and for malformed ones.
+ */
+inline bool split_exec(const std::string& exec, const DockIcon& icon, const std::string& desktop_file,
+                       std::vector<std::string>& argv)
+{
+    argv.clear();
+    std::string arg;
+    bool have_arg = false, quoted = false;
+    for (size_t i = 0; i < exec.size(); i++) {
+        char c = exec[i];
+        if (quoted) {
+            if (c == '"') {
+                quoted = false;
+            } else if (c == '\\' && i + 1 < exec.size() && std::strchr("\"`$\\", exec[i + 1])) {
+                arg += exec[++i];
+            } else {
+                arg += c;
+            }
+            continue;
+        }
+
+        if (c == ' ' || c == '\t') {
+            if (have_arg) argv.push_back(std::move(arg));
+            arg.clear();
+            have_arg = false;
+        } else if (c == '"') {
+            quoted = have_arg = true;
+        } else if (c == '%') {
+            if (++i == exec.size()) return false;
+            bool alone = !have_arg && (i + 1 == exec.size() || exec[i + 1] == ' ' || exec[i + 1] == '\t');
+            switch (exec[i]) {
+              case '%': arg += '%'; have_arg = true; break;
+              case 'c': arg += icon.name; have_arg = true; break;
+              case 'k': arg += desktop_file; have_arg = true; break;
+              case 'i':
+                if (alone && !icon.icon_name.empty()) {
+                    argv.push_back("--icon");
+                    argv.push_back(icon.icon_name);
+                }
+                break;
+              case 'f': case 'F': case 'u': case 'U':
+              case 'd': case 'D': case 'n': case 'N': case 'v': case 'm':
+                break;
+              default:
+                return false;
+            }
+        } else if (std::strchr("'\\><~|&;$*?#()`\n", c)) {
+            return false;
+        } else {
+            arg += c;
+            have_arg = true;
+        }
+    }
+    if (quoted) return false;
+    if (have_arg) argv.push_back(std::move(arg));
+    return !argv.empty();
+}
+
+/**
+ * Per-icon attributes of the instanced icon draw, see icon_vertex_shader_src.
+ * One array per attribute, here and in the instance buffer, so that a frame
+ * rewrites only the hover values: the rest changes with the layout and the
+ * icon images alone.
+ */
+struct IconInstances
+{
+    std::vector<glm::vec2> offset;  // top-left corner, mirrored
+    std::vector<float> hover;
+    std::vector<glm::vec4> uv;      // the atlas rect
+    std::vector<float> running;     // 1 with a running indicator
+    std::vector<float> scale;       // growth under the lens
+    std::vector<wlr_box> bounds;    // on-screen extent, clipped to the dock
+    std::vector<int> icon;          // index in DockScene::icons
+
+    size_t size() const { return icon.size(); }
+    bool empty() const { return icon.empty(); }
+
+    void reserve(size_t count)
+    {
+        offset.reserve(count);
+        hover.reserve(count);
+        uv.reserve(count);
+        running.reserve(count);
+        scale.reserve(count);
+        bounds.reserve(count);
+        icon.reserve(count);
+    }
+
+    void clear()
+    {
+        offset.clear();
+        hover.clear();
+        uv.clear();
+        running.clear();
+        scale.clear();
+        bounds.clear();
+        icon.clear();
+    }
+};
+
+class ShaderProgram
+{
+  public:
+    GLuint program = 0;
+    GLint u_mvp = -1;
+    GLint u_texture = -1;
+    GLint u_resolution = -1;
+    GLint u_corner_radius = -1;
+    GLint u_bevel_color = -1;
+    GLint u_background_color = -1;
+    GLint u_time = -1;
+    GLint u_shimmer_time = -1;
+    GLint u_highlight_phase = -1;
+    GLint u_bevel_shading = -1;
+    GLint u_bevel_distance = -1;
+    GLint u_indicator = -1;
+    GLint u_samples = -1;
+
+    /**
+     * Build the program from source, or from a binary the driver handed out
+     * for the same sources on an earlier start. @defines is inserted into
+     * both sources, right after their #version line, to select a variant.
+     */
+    bool compile(const char* vert, const char* frag, const char* defines = "")
+    {
+        std::string vert_with_defines = insert_defines(vert, defines);
+        std::string frag_with_defines = insert_defines(frag, defines);
+        const char* vert_src = vert_with_defines.c_str();
+        const char* frag_src = frag_with_defines.c_str();
+
+        std::string cache_path = binary_cache_file(vert_src, frag_src);
+        if (load_binary(cache_path)) {
+            LOGD("shader-dock: loaded program binary ", cache_path);
+            locate_uniforms();
+            return true;
+        }
+
+        if (!compile_source(vert_src, frag_src)) return false;
+        locate_uniforms();
+        save_binary(cache_path);
+        return true;
+    }
+
+    void destroy()
+    {
+        if (program) {
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+
+  private:
+    struct BinaryHeader
+    {
+        char magic[4];  // "SDPB"
+        uint32_t format;
+        uint32_t length;
+    };
+
+    static std::string insert_defines(const char* src, const char* defines)
+    {
+        std::string out = src;
+        size_t line_end = out.find('\n');
+        out.insert(line_end == std::string::npos ? out.size() : line_end + 1, defines);
+        return out;
+    }
+
+    static std::string binary_cache_file(const char* vert_src, const char* frag_src)
+    {
+        // A driver update invalidates binaries, so the driver is part of the key
+        CacheKey key;
+        for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+            auto str = (const char*)glGetString(name);
+            key.mix(str ? str : "");
+        }
+        key.mix(vert_src);
+        key.mix(frag_src);
+        return cache_base_dir() + "/programs/" + key.hex() + ".bin";
+    }
+
+    bool load_binary(const std::string& path)
+    {
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        if (formats <= 0) return false;
+
+        auto file = map_file(path, false);
+        if (!file || file->length < sizeof(BinaryHeader)) return false;
+        auto hdr = (const BinaryHeader*)file->bytes();
+        if (std::memcmp(hdr->magic, "SDPB", 4) != 0 || hdr->length != file->length - sizeof(BinaryHeader))
+            return false;
+
+        program = glCreateProgram();
+        glProgramBinary(program, hdr->format, hdr + 1, hdr->length);
+        GLint success;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            // Rejected binaries are normal after driver changes; rebuild
+            glDeleteProgram(program);
+            program = 0;
+            return false;
+        }
+        return true;
+    }
+
+    void save_binary(const std::string& path)
+    {
+        GLint formats = 0, length = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        if (formats <= 0) return;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) return;
+
+        std::vector<uint8_t> binary(length);
+        GLenum format;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+
+        BinaryHeader hdr;
+        std::memcpy(hdr.magic, "SDPB", 4);
+        hdr.format = format;
+        hdr.length = length;
+        write_cache_file(path, {{&hdr, sizeof(hdr)}, {binary.data(), (size_t)length}});
+    }
+
+    bool compile_source(const char* vert_src, const char* frag_src)
+    {
+        GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vs, 1, &vert_src, nullptr);
+        glCompileShader(vs);
+        
+        GLint success;
+        glGetShaderiv(vs, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            char log[512];
+            glGetShaderInfoLog(vs, 512, nullptr, log);
+            LOGD("VS compile error: ", log);
+            glDeleteShader(vs);
+            return false;
+        }
+
+        GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fs, 1, &frag_src, nullptr);
+        glCompileShader(fs);
+        
+        glGetShaderiv(fs, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            char log[512];
+            glGetShaderInfoLog(fs, 512, nullptr, log);
+            LOGD("FS compile error: ", log);
+            glDeleteShader(vs);
+            glDeleteShader(fs);
+            return false;
+        }
+
+        program = glCreateProgram();
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glAttachShader(program, vs);
+        glAttachShader(program, fs);
+        glLinkProgram(program);
+        
+        glDeleteShader(vs);
+        glDeleteShader(fs);
+
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            char log[512];
+            glGetProgramInfoLog(program, 512, nullptr, log);
+            LOGD("Program link error: ", log);
+            glDeleteProgram(program);
+            program = 0;
+            return false;
+        }
+        return true;
+    }
+
+    void locate_uniforms()
+    {
+        u_mvp = glGetUniformLocation(program, "u_mvp");
+        u_texture = glGetUniformLocation(program, "u_texture");
+        u_resolution = glGetUniformLocation(program, "iResolution");
+        u_corner_radius = glGetUniformLocation(program, "cornerRadius");
+        u_bevel_color = glGetUniformLocation(program, "bevelColor");
+        u_background_color = glGetUniformLocation(program, "backgroundColor");
+        u_time = glGetUniformLocation(program, "time");
+        u_shimmer_time = glGetUniformLocation(program, "shimmerTime");
+        u_highlight_phase = glGetUniformLocation(program, "highlightPhase");
+        u_bevel_shading = glGetUniformLocation(program, "u_bevel_shading");
+        u_bevel_distance = glGetUniformLocation(program, "u_bevel_distance");
+        u_indicator = glGetUniformLocation(program, "indicator");
+        u_samples = glGetUniformLocation(program, "samples");
+    }
+};
+
+/**
+ * Icon images packed into a single texture, so that the whole icon row can
+ * be drawn with one instanced call. Images are placed on shelves, left to
+ * right, separated by a transparent gutter. The texture doubles in size,
+ * keeping its contents, when the next image does not fit. Released rects
+ * are kept on a free list and reused by later images that fit into them.
+ *
+ * Images are scaled for icons grown all the way by the lens, so icons at
+ * rest show them at up to half their size. A second, half size level,
+ * regenerated by update_mipmaps(), keeps those from aliasing.
+ */
+class IconAtlas
+{
+  public:
+    GLuint texture = 0;
+    int width = 0;
+    int height = 0;
+
+    /**
+     * Reserve a free w x h spot of the atlas, growing it if necessary.
+     * Must not be called with a GL_PIXEL_UNPACK_BUFFER bound.
+     * Changes the GL_TEXTURE_2D binding of the active texture unit.
+     */
+    bool allocate(int w, int h, AtlasRect& out)
+    {
+        if (!texture && !grow(w + gutter, h + gutter)) return false;
+        if (take_free_rect(w, h, out)) return true;
+
+        // Current shelf first, then a new one, and only then grow
+        while (shelf_x + w + gutter > width || shelf_y + h + gutter > height) {
+            if (w + gutter <= width && shelf_y + shelf_height + h + gutter <= height) {
+                shelf_x = 0;
+                shelf_y += shelf_height;
+                shelf_height = 0;
+            } else if (!grow(w + gutter, h + gutter)) {
+                return false;
+            }
+        }
+
+        out = {shelf_x, shelf_y, w, h};
+        shelf_x += w + gutter;
+        shelf_height = std::max(shelf_height, h + gutter);
+        return true;
+    }
+
+    /**
+     * Upload RGBA pixels into @r. With a GL_PIXEL_UNPACK_BUFFER bound,
+     * @pixels is an offset into that buffer.
+     */
+    void upload(const uint8_t* pixels, const AtlasRect& r)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, r.x, r.y, r.width, r.height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        mipmaps_dirty = true;
+    }
+
+    /**
+     * Bring the half size level up to date after uploads, once for all of
+     * them. Changes the GL_TEXTURE_2D binding of the active texture unit.
+     */
+    void update_mipmaps()
+    {
+        if (!texture || !mipmaps_dirty) return;
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        mipmaps_dirty = false;
+    }
+
+    /** Give the space of @r back for reuse by a later allocate(). */
+    void free(const AtlasRect& r)
+    {
+        free_rects.push_back(r);
+    }
+
+    /**
+     * Normalized texture rect (x, y, width, height) of @r, inset by half a
+     * texel so that linear filtering never reads into the gutter.
+     */
+    void uv_rect(const AtlasRect& r, float& u, float& v, float& uw, float& vh) const
+    {
+        u = (r.x + 0.5f) / width;
+        v = (r.y + 0.5f) / height;
+        uw = (r.width - 1.0f) / width;
+        vh = (r.height - 1.0f) / height;
+    }
+
+    void destroy()
+    {
+        if (texture) glDeleteTextures(1, &texture);
+        texture = 0;
+        width = height = 0;
+        shelf_x = shelf_y = shelf_height = 0;
+        free_rects.clear();
+        mipmaps_dirty = false;
+    }
+
+  private:
+    // Two texels of the half size level, so that neither level filters
+    // one image into the next
+    static constexpr int gutter = 4;
+    static constexpr int initial_size = 512;
+    int shelf_x = 0, shelf_y = 0, shelf_height = 0;
+    std::vector<AtlasRect> free_rects;
+    bool mipmaps_dirty = false;
+
+    // Smallest released rect that can hold a w x h image
+    bool take_free_rect(int w, int h, AtlasRect& out)
+    {
+        auto best = free_rects.end();
+        for (auto it = free_rects.begin(); it != free_rects.end(); ++it) {
+            if (it->width < w || it->height < h) continue;
+            if (best == free_rects.end() || it->width * it->height < best->width * best->height)
+                best = it;
+        }
+        if (best == free_rects.end()) return false;
+
+        out = {best->x, best->y, w, h};
+        free_rects.erase(best);
+        return true;
+    }
+
+    bool grow(int min_width, int min_height)
+    {
+        GLint max_size;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+
+        int new_width = std::max(width, initial_size);
+        int new_height = std::max(height, initial_size);
+        if (texture) {
+            if (new_width <= new_height) new_width *= 2;
+            else new_height *= 2;
+        }
+        while (new_width < min_width) new_width *= 2;
+        while (new_height < min_height) new_height *= 2;
+        if (new_width > max_size || new_height > max_size) {
+            LOGD("shader-dock: icon atlas cannot grow beyond ", max_size, "px");
+            return false;
+        }
+
+        // Start out transparent so the gutters stay empty
+        std::vector<uint8_t> clear(new_width * new_height * 4, 0);
+        GLuint new_texture;
+        glGenTextures(1, &new_texture);
+        glBindTexture(GL_TEXTURE_2D, new_texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, new_width, new_height, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, clear.data());
+
+        if (texture) {
+            // Copy the old contents over through a read framebuffer
+            GLint prev_read_fb;
+            glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &prev_read_fb);
+            GLuint fb;
+            glGenFramebuffers(1, &fb);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, fb);
+            glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+            glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, prev_read_fb);
+            glDeleteFramebuffers(1, &fb);
+            glDeleteTextures(1, &texture);
+        }
+
+        texture = new_texture;
+        width = new_width;
+        height = new_height;
+        mipmaps_dirty = true;
+        return true;
+    }
+};
+
+/**
+ * The parts of the icon bevel that only depend on the icon size and corner
+ * radius, baked once into two textures covering an icon: the rounded box
+ * distance, and the button height, lighting and highlight angle. The icon
+ * shader then gets away with lookups plus the terms that change over time.
+ */
+class BevelMask
+{
+  public:
+    // Button height, lighting, sin and cos of twice the angle from the center
+    GLuint shading = 0;
+    // Signed distance to the rounded box edge, in logical pixels
+    GLuint distance = 0;
+
+    /**
+     * (Re)bake the mask for @size x @size logical pixel icons drawn with
+     * @texels pixels, unless it already is. Changes the GL_TEXTURE_2D
+     * binding of the active texture unit.
+     */
+    void ensure(int texels, int size, float radius)
+    {
+        if (shading && texels == baked_texels && size == baked_size && radius == baked_radius)
+            return;
+
+        std::vector<float> shading_data(texels * texels * 4);
+        std::vector<float> distance_data(texels * texels);
+        float half = size * 0.5f;
+        for (int y = 0; y < texels; y++) {
+            for (int x = 0; x < texels; x++) {
+                // Texel centers line up with the fragments of an icon
+                float px = ((x + 0.5f) / texels - 0.5f) * size;
+                float py = ((y + 0.5f) / texels - 0.5f) * size;
+                float len = std::hypot(px, py);
+
+                float qx = std::abs(px) - half + radius;
+                float qy = std::abs(py) - half + radius;
+                distance_data[y * texels + x] = std::min(std::max(qx, qy), 0.0f) +
+                    std::hypot(std::max(qx, 0.0f), std::max(qy, 0.0f)) - radius;
+
+                float center_distance = len / half;
+                float t = std::clamp(center_distance / 0.8f, 0.0f, 1.0f);
+                float height = 1.0f - t * t * (3.0f - 2.0f * t);
+                height *= height;
+
+                // Light comes from the top left
+                float nx = len > 0.0f ? px / len : 0.0f;
+                float ny = len > 0.0f ? py / len : 0.0f;
+                float lighting = 0.5f + (nx + ny) * -0.70710678f * 0.3f * height;
+
+                float angle = std::atan2(py, px);
+                float* out = &shading_data[(y * texels + x) * 4];
+                out[0] = height;
+                out[1] = lighting;
+                out[2] = std::sin(angle * 2.0f);
+                out[3] = std::cos(angle * 2.0f);
+            }
+        }
+
+        if (!shading) {
+            shading = create_texture();
+            distance = create_texture();
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, shading);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, texels, texels, 0, GL_RGBA, GL_FLOAT, shading_data.data());
+        glBindTexture(GL_TEXTURE_2D, distance);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, texels, texels, 0, GL_RED, GL_FLOAT, distance_data.data());
+
+        baked_texels = texels;
+        baked_size = size;
+        baked_radius = radius;
+    }
+
+    void destroy()
+    {
+        if (shading) glDeleteTextures(1, &shading);
+        if (distance) glDeleteTextures(1, &distance);
+        shading = distance = 0;
+    }
+
+  private:
+    int baked_texels = 0;
+    int baked_size = 0;
+    float baked_radius = 0.0f;
+
+    static GLuint create_texture()
+    {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return texture;
+    }
+};
+
+// ============================================================================
+// Helper Functions
+// ============================================================================
+
+/** Decode a PNG file into tightly packed 8-bit RGBA. */
+inline bool decode_png(const std::string& path, std::vector<uint8_t>& pixels, int& width, int& height)
+{
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp) return false;
+
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    if (!png) { fclose(fp); return false; }
+
+    png_infop info = png_create_info_struct(png);
+    if (!info) { png_destroy_read_struct(&png, nullptr, nullptr); fclose(fp); return false; }
+
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_read_struct(&png, &info, nullptr);
+        fclose(fp);
+        return false;
+    }
+
+    png_init_io(png, fp);
+    png_read_info(png, info);
+
+    width = png_get_image_width(png, info);
+    height = png_get_image_height(png, info);
+    png_byte color_type = png_get_color_type(png, info);
+    png_byte bit_depth = png_get_bit_depth(png, info);
+
+    if (bit_depth == 16) png_set_strip_16(png);
+    if (color_type == PNG_COLOR_TYPE_PALETTE) png_set_palette_to_rgb(png);
+    if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8) png_set_expand_gray_1_2_4_to_8(png);
+    if (png_get_valid(png, info, PNG_INFO_tRNS)) png_set_tRNS_to_alpha(png);
+    if (color_type == PNG_COLOR_TYPE_RGB || color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_PALETTE)
+        png_set_filler(png, 0xFF, PNG_FILLER_AFTER);
+    if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
+        png_set_gray_to_rgb(png);
+
+    png_read_update_info(png, info);
+
+    std::vector<png_bytep> row_pointers(height);
+    pixels.resize(width * height * 4);
+    for (int y = 0; y < height; y++)
+        row_pointers[y] = pixels.data() + y * width * 4;
+
+    png_read_image(png, row_pointers.data());
+    png_destroy_read_struct(&png, &info, nullptr);
+    fclose(fp);
+
+    return true;
+}
+
+/**
+ * Downscale RGBA pixels with an area filter: each destination pixel is the
+ * coverage-weighted average of the source pixels under it. Filtering works
+ * on premultiplied values so that transparent edges do not darken.
+ */
+inline void downscale_rgba(const uint8_t *src, int sw, int sh,
+                           std::vector<uint8_t>& dst, int dw, int dh)
+{
+    std::vector<float> pre(sw * sh * 4);
+    for (int i = 0; i < sw * sh; i++) {
+        float a = src[i * 4 + 3] / 255.0f;
+        pre[i * 4 + 0] = src[i * 4 + 0] * a;
+        pre[i * 4 + 1] = src[i * 4 + 1] * a;
+        pre[i * 4 + 2] = src[i * 4 + 2] * a;
+        pre[i * 4 + 3] = src[i * 4 + 3];
+    }
+
+    // Average [start, end) of a line of @len samples, @stride floats apart
+    auto average = [] (const float* line, int len, int stride, float start, float end, float* out) {
+        float acc[4] = {0, 0, 0, 0};
+        float total = 0.0f;
+        for (int i = (int)start; i < std::min((int)std::ceil(end), len); i++) {
+            float w = std::min(i + 1.0f, end) - std::max((float)i, start);
+            for (int c = 0; c < 4; c++) acc[c] += line[i * stride + c] * w;
+            total += w;
+        }
+        for (int c = 0; c < 4; c++) out[c] = total > 0.0f ? acc[c] / total : 0.0f;
+    };
+
+    float sx = (float)sw / dw, sy = (float)sh / dh;
+    std::vector<float> rows(dw * sh * 4);
+    for (int y = 0; y < sh; y++)
+        for (int x = 0; x < dw; x++)
+            average(&pre[y * sw * 4], sw, 4, x * sx, (x + 1) * sx, &rows[(y * dw + x) * 4]);
+
+    dst.resize(dw * dh * 4);
+    for (int x = 0; x < dw; x++)
+        for (int y = 0; y < dh; y++) {
+            float px[4];
+            average(&rows[x * 4], sh, dw * 4, y * sy, (y + 1) * sy, px);
+            float a = px[3] / 255.0f;
+            for (int c = 0; c < 3; c++)
+                dst[(y * dw + x) * 4 + c] = (uint8_t)std::clamp(a > 0.0f ? px[c] / a + 0.5f : 0.0f, 0.0f, 255.0f);
+            dst[(y * dw + x) * 4 + 3] = (uint8_t)std::clamp(px[3] + 0.5f, 0.0f, 255.0f);
+        }
+}
+
+/**
+ * Scale a decoded icon down so that its larger side is @size pixels, into
+ * @pixels. Returns false for images that already fit, which are kept as
+ * they are: the GPU magnifies them just as well.
+ */
+inline bool scale_icon_image(const uint8_t *src, int sw, int sh, int size,
+                             std::vector<uint8_t>& pixels, int& width, int& height)
+{
+    if (size <= 0 || (sw <= size && sh <= size)) return false;
+
+    width = sw >= sh ? size : std::max(1, (int)std::lround((float)sw * size / sh));
+    height = sh >= sw ? size : std::max(1, (int)std::lround((float)sh * size / sw));
+    downscale_rgba(src, sw, sh, pixels, width, height);
+    return true;
+}
+
+// ============================================================================
+// Frame Statistics
+// ============================================================================
+
+#ifndef GL_TIME_ELAPSED_EXT
+#define GL_TIME_ELAPSED_EXT 0x88BF
+#endif
+#ifndef GL_GPU_DISJOINT_EXT
+#define GL_GPU_DISJOINT_EXT 0x8FBB
+#endif
+
+/** The last values of a per-frame cost, for percentiles. Pushing never allocates. */
+class RollingStat
+{
+  public:
+    static constexpr size_t window = 120;
+
+    RollingStat()
+    {
+        values.reserve(window);
+    }
+
+    void push(float value)
+    {
+        if (values.size() < window) values.push_back(value);
+        else values[next] = value;
+        next = (next + 1) % window;
+    }
+
+    /** The @p quantile, from 0 to 1, of the window. */
+    float percentile(float p) const
+    {
+        if (values.empty()) return 0.0f;
+        std::vector<float> sorted = values;
+        auto nth = sorted.begin() + std::min(sorted.size() - 1, (size_t)(p * sorted.size()));
+        std::nth_element(sorted.begin(), nth, sorted.end());
+        return *nth;
+    }
+
+    /** The last @count values into @out, oldest first, zeros while there are fewer. */
+    void recent(float *out, size_t count) const
+    {
+        size_t n = std::min(count, values.size());
+        std::fill(out, out + count - n, 0.0f);
+        for (size_t k = 0; k < n; k++)
+            out[count - n + k] = values[(next + values.size() - n + k) % values.size()];
+    }
+
+  private:
+    std::vector<float> values;
+    size_t next = 0;
+};
+
+/**
+ * GPU time of the dock's render passes, from GL_EXT_disjoint_timer_query.
+ * Each measured frame takes a slot of a small ring of queries, read back
+ * frames later once the results are there, so that measuring never waits
+ * for the GPU. Frames that find the ring full go unmeasured.
+ */
+class PassTimer
+{
+  public:
+    enum Pass { Background, Icons, pass_count };
+
+    /** Start measuring a frame. Every pass must be timed until end_frame(). */
+    bool begin_frame()
+    {
+        if (!supported()) return false;
+        if (!queries[0][0]) glGenQueries(ring_size * pass_count, &queries[0][0]);
+        if (pending[next]) return false;
+        measuring = true;
+        return true;
+    }
+
+    void begin(Pass pass)
+    {
+        if (measuring) glBeginQuery(GL_TIME_ELAPSED_EXT, queries[next][pass]);
+    }
+
+    void end()
+    {
+        if (measuring) glEndQuery(GL_TIME_ELAPSED_EXT);
+    }
+
+    void end_frame()
+    {
+        if (!measuring) return;
+        measuring = false;
+        pending[next] = true;
+        next = (next + 1) % ring_size;
+    }
+
+    bool has_pending() const
+    {
+        return std::find(std::begin(pending), std::end(pending), true) != std::end(pending);
+    }
+
+    /** Hand the pass times of frames the GPU finished, in ms, to @on_frame. */
+    template<class F>
+    void collect(F&& on_frame)
+    {
+        if (!has_pending()) return;
+
+        // A disjoint event, such as a GPU reset, spoils what is in flight
+        GLint disjoint = 0;
+        glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+        for (int k = 0; k < ring_size; k++) {
+            int slot = (next + k) % ring_size;  // oldest first
+            if (!pending[slot]) continue;
+            GLuint available = 0;
+            glGetQueryObjectuiv(queries[slot][pass_count - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) break;
+
+            pending[slot] = false;
+            if (disjoint) continue;
+            float ms[pass_count];
+            for (int pass = 0; pass < pass_count; pass++) {
+                GLuint ns = 0;
+                glGetQueryObjectuiv(queries[slot][pass], GL_QUERY_RESULT, &ns);
+                ms[pass] = ns / 1e6f;
+            }
+            on_frame(ms);
+        }
+    }
+
+    /** Needs the GL context. */
+    void destroy()
+    {
+        if (queries[0][0]) glDeleteQueries(ring_size * pass_count, &queries[0][0]);
+        queries[0][0] = 0;
+        std::fill(std::begin(pending), std::end(pending), false);
+    }
+
+  private:
+    static constexpr int ring_size = 4;
+    GLuint queries[ring_size][pass_count] = {};
+    bool pending[ring_size] = {};
+    int next = 0;
+    bool measuring = false;
+    int support = -1;
+
+    bool supported()
+    {
+        if (support < 0) {
+            auto extensions = (const char*)glGetString(GL_EXTENSIONS);
+            support = extensions && std::strstr(extensions, "GL_EXT_disjoint_timer_query");
+            if (!support) LOGD("shader-dock: no GL_EXT_disjoint_timer_query, GPU times are not measured");
+        }
+        return support;
+    }
+};
+
+// ============================================================================
+// Renderer
+// ============================================================================
+
+// Largest bounce of icon_fragment_shader_src: 1.0 + hover * (0.05 + 0.08)
+static constexpr float max_bounce_overscale = 0.13f;
+
+/** The overlap of @a and @b, {0, 0, 0, 0} if there is none. */
+inline wlr_box box_intersection(const wlr_box& a, const wlr_box& b)
+{
+    int x1 = std::max(a.x, b.x), y1 = std::max(a.y, b.y);
+    int x2 = std::min(a.x + a.width, b.x + b.width), y2 = std::min(a.y + a.height, b.y + b.height);
+    if (x2 <= x1 || y2 <= y1) return {0, 0, 0, 0};
+    return {x1, y1, x2 - x1, y2 - y1};
+}
+
+inline double box_area(const wlr_box& box)
+{
+    return box.width > 0 && box.height > 0 ? (double)box.width * box.height : 0.0;
+}
+
+/**
+ * Whether a pointer at @x, @y calls an autohiding @dock back, with @dock
+ * where it is when shown. A dock that is away only answers to the first
+ * @hotspot pixels of the output edge. Once @called, the whole strip from
+ * the edge to the dock's far side keeps it out, or heading from the edge
+ * to the dock would send it away again.
+ */
+inline bool pointer_calls_dock(const wlr_box& dock, double x, double y, bool called, int hotspot)
+{
+    if (x < 0 || y < dock.y || y >= dock.y + dock.height) return false;
+    return x < (called ? dock.x + dock.width : hotspot);
+}
+
+/**
+ * The dock's shader programs, compiled once per render quality, along with
+ * the bevel masks of the icon shader. Compilation waits for the first use
+ * of a quality, where the GL context is current.
+ */
+class DockPrograms
+{
+  public:
+    struct Variant
+    {
+        ShaderProgram icon;
+        ShaderProgram background;
+        ShaderProgram cache;
+        ShaderProgram indicator;
+        bool attempted = false;
+    };
+
+    /** The programs of @quality, or nullptr if they fail to build. */
+    const Variant* get(RenderQuality quality)
+    {
+        auto& variant = variants[(int)quality];
+        if (!variant.attempted) {
+            variant.attempted = true;
+            const char* defines = quality_defines(quality);
+            if (!variant.icon.compile(icon_vertex_shader_src, icon_fragment_shader_src, defines)) {
+                LOGD("shader-dock: icon shader failed");
+            } else if (!variant.background.compile(vertex_shader_src, background_fragment_shader_src, defines)) {
+                LOGD("shader-dock: bg shader failed");
+                variant.icon.destroy();
+            } else if (!variant.cache.compile(vertex_shader_src, cache_fragment_shader_src, defines)) {
+                LOGD("shader-dock: cache shader failed");
+                variant.icon.destroy();
+                variant.background.destroy();
+            } else if (!variant.indicator.compile(indicator_vertex_shader_src, indicator_fragment_shader_src, defines)) {
+                LOGD("shader-dock: indicator shader failed");
+                variant.icon.destroy();
+                variant.background.destroy();
+                variant.cache.destroy();
+            }
+        }
+        return variant.icon.program ? &variant : nullptr;
+    }
+
+    /** The frame cost overlay's program, or nullptr if it fails to build. */
+    const ShaderProgram* stats()
+    {
+        if (!stats_attempted) {
+            stats_attempted = true;
+            if (!stats_program.compile(vertex_shader_src, stats_fragment_shader_src))
+                LOGD("shader-dock: stats shader failed");
+        }
+        return stats_program.program ? &stats_program : nullptr;
+    }
+
+    /**
+     * The bevel mask for icons drawn with @texels pixels, baked for the
+     * current @size and @radius. Outputs with different scales each get
+     * their own.
+     */
+    const BevelMask& bevel_mask(int texels, int size, float radius)
+    {
+        auto& mask = bevel_masks[texels];
+        mask.ensure(texels, size, radius);
+        return mask;
+    }
+
+    ~DockPrograms()
+    {
+        for (auto& variant : variants) {
+            variant.icon.destroy();
+            variant.background.destroy();
+            variant.cache.destroy();
+            variant.indicator.destroy();
+        }
+        for (auto& [texels, mask] : bevel_masks) mask.destroy();
+        stats_program.destroy();
+    }
+
+  private:
+    Variant variants[3];
+    ShaderProgram stats_program;
+    bool stats_attempted = false;
+    std::unordered_map<int, BevelMask> bevel_masks;
+};
+
+/**
+ * The magnification under the pointer: icons within @radius of @focus
+ * along the dock grow as under a fisheye lens, which magnifies 1 + @strength
+ * times at the focus; an icon there grows a little less, the more of the
+ * lens it covers. The icons nearer its rim shrink to make room, so that
+ * nothing outside of the lens moves: by k / 4 at most for a strength k,
+ * which is why the strength stops at max_lens_strength.
+ */
+struct DockLens
+{
+    float focus = 0.0f;     // output-local y of the pointer
+    float strength = 0.0f;  // 0 without magnification
+    float radius = 1.0f;    // logical pixels along the dock
+};
+
+/** The strongest lens, with which the icons near its rim keep 3/4 of their size. */
+constexpr float max_lens_strength = 1.0f;
+
+/**
+ * Where the icons of the vertical dock go, in the same coordinates as the
+ * dock rectangle.
+ */
+struct DockLayout
+{
+    wlr_box dock{0, 0, 0, 0};
+    int count = 0;  // icons
+    int icon_size = 64, spacing = 8, margin = 8;
+    // Docks taller than the output show a window onto their icons, this
+    // far down from the first slot
+    int scroll_offset = 0;
+
+    /**
+     * On-screen rectangle of icon i, which may be scrolled out of the dock.
+     * The array is drawn top to bottom but the output presents it mirrored
+     * (see icon_at()), so the visual slot is counted from the other end.
+     */
+    wlr_box icon_rect(int i) const
+    {
+        int slot = count - 1 - i;
+        return {dock.x + margin, dock.y + margin + slot * (icon_size + spacing) - scroll_offset,
+                icon_size, icon_size};
+    }
+
+    /** Everything icon @i can draw to, see icon_rect(). */
+    wlr_box icon_bounds(int i) const
+    {
+        // Grow by the bounce overscale plus the anti-aliasing band
+        int pad = (int)std::ceil(icon_size * max_bounce_overscale * 0.5f) + 2;
+        auto box = icon_rect(i);
+        return {box.x - pad, box.y - pad, box.width + 2 * pad, box.height + 2 * pad};
+    }
+
+    int icon_at(int x, int y) const
+    {
+        if (x < dock.x || x >= dock.x + dock.width || y < dock.y || y >= dock.y + dock.height)
+            return -1;
+        int ly = y - dock.y - margin + scroll_offset;
+        if (ly < 0) return -1;
+        int idx = ly / (icon_size + spacing);
+        int off = ly % (icon_size + spacing);
+        if (idx >= 0 && idx < count && off < icon_size) {
+            // Reverse index to match visual order (icons render bottom-to-top in array)
+            return count - 1 - idx;
+        }
+        return -1;
+    }
+
+    /**
+     * Where to draw for the output to show @rect: it presents the dock
+     * mirrored about its center, see icon_rect().
+     */
+    wlr_box mirrored(const wlr_box& rect) const
+    {
+        return {rect.x, 2 * dock.y + dock.height - rect.y - rect.height, rect.width, rect.height};
+    }
+
+    /** The icons @lens touches, from @first to @last. False if there are none. */
+    bool lens_span(const DockLens& lens, int& first, int& last) const
+    {
+        if (lens.strength <= 0.0f || count == 0) return false;
+
+        // Visual slots whose centers are within the radius, and the one
+        // past it at either end, which may still reach into it
+        float pitch = icon_size + spacing;
+        float center = dock.y + margin - scroll_offset + icon_size * 0.5f;
+        int top = std::max(0, (int)std::floor((lens.focus - lens.radius - center) / pitch));
+        int bottom = std::min(count - 1, (int)std::ceil((lens.focus + lens.radius - center) / pitch));
+        if (top > bottom) return false;
+        first = count - 1 - bottom;
+        last = count - 1 - top;
+        return true;
+    }
+
+    /**
+     * Where icon @i shows under @lens: the top of its rect and how much it
+     * grew. Icons grow away from the output edge, out of the dock. One
+     * centered on the focus grows 1 + k (1 - h)^3 times, for the strength
+     * k and half the icon taking h of the radius.
+     */
+    void magnify(int i, const DockLens& lens, float& top, float& scale) const
+    {
+        auto rect = icon_rect(i);
+        top = rect.y;
+        scale = 1.0f;
+        if (lens.strength <= 0.0f) return;
+
+        // Both edges move along g(t) = t + k t (1 - t)^3, which keeps the
+        // focus and the rim in place and never turns back, so icons keep
+        // their order and gaps. Its slope goes from 1 + k at the focus to 1
+        // at the rim; with the rim fixed the mean slope is 1, so it dips to
+        // 1 - k / 4 at t = 1 / 2. An icon grows by the mean slope over it.
+        float k = std::min(lens.strength, max_lens_strength);
+        auto lensed = [&] (float y) {
+            float offset = y - lens.focus;
+            float t = std::abs(offset) / lens.radius;
+            if (t >= 1.0f) return y;
+            float u = 1.0f - t;
+            return lens.focus + std::copysign(lens.radius * (t + k * t * u * u * u), offset);
+        };
+        top = lensed(rect.y);
+        scale = (lensed(rect.y + rect.height) - top) / rect.height;
+    }
+
+    /** Everything icon @i can draw to under @lens, see icon_bounds(). */
+    wlr_box magnified_bounds(int i, const DockLens& lens) const
+    {
+        float top, scale;
+        magnify(i, lens, top, scale);
+        if (scale == 1.0f) return icon_bounds(i);
+
+        auto rect = icon_rect(i);
+        int pad = (int)std::ceil(icon_size * scale * max_bounce_overscale * 0.5f) + 2;
+        int y1 = (int)std::floor(top), y2 = (int)std::ceil(top + rect.height * scale);
+        int width = (int)std::ceil(rect.width * scale);
+        return {rect.x - pad, y1 - pad, width + 2 * pad, y2 - y1 + 2 * pad};
+    }
+
+    /**
+     * Everything @lens can change: the icons around its focus, at rest and
+     * grown, with their running indicators. Icons only show within the
+     * dock's height.
+     */
+    wlr_box lens_bounds(const DockLens& lens) const
+    {
+        float grown = icon_size * (1.0f + lens.strength);
+        int pad = (int)std::ceil(grown * max_bounce_overscale * 0.5f) + 2;
+        int y1 = (int)std::floor(lens.focus - lens.radius - grown * 0.5f) - pad;
+        int y2 = (int)std::ceil(lens.focus + lens.radius + grown * 0.5f) + pad;
+        int x2 = lens_reach(lens.strength);
+        return box_intersection({dock.x, y1, x2 - dock.x, y2 - y1}, {dock.x, dock.y, x2 - dock.x, dock.height});
+    }
+
+    /** The right edge of what icons can draw to under a lens of @strength. */
+    int lens_reach(float strength) const
+    {
+        float grown = icon_size * (1.0f + strength);
+        int pad = (int)std::ceil(grown * max_bounce_overscale * 0.5f) + 2;
+        return std::max(dock.x + dock.width, dock.x + margin + (int)std::ceil(grown) + pad);
+    }
+
+    /** icon_at() for the icons as @lens shows them. */
+    int magnified_icon_at(int x, int y, const DockLens& lens) const
+    {
+        int first, last;
+        if (!lens_span(lens, first, last)) return icon_at(x, y);
+        if (y < dock.y || y >= dock.y + dock.height) return -1;
+
+        for (int i = first; i <= last; i++) {
+            float top, scale;
+            magnify(i, lens, top, scale);
+            auto rect = icon_rect(i);
+            float size = rect.width * scale;
+            if (x >= rect.x && x < rect.x + size && y >= top && y < top + size) return i;
+        }
+        // Between the grown icons; the icons beyond the lens did not move
+        int icon = icon_at(x, y);
+        return icon >= first && icon <= last ? -1 : icon;
+    }
+
+    bool operator==(const DockLayout& other) const
+    {
+        return dock.x == other.dock.x && dock.y == other.dock.y && dock.width == other.dock.width &&
+            dock.height == other.dock.height && count == other.count && icon_size == other.icon_size &&
+            spacing == other.spacing && margin == other.margin && scroll_offset == other.scroll_offset;
+    }
+};
+
+/** Everything a frame of the dock shows. */
+struct DockScene
+{
+    DockLayout layout;
+    const DockIcon *icons = nullptr;  // layout.count of them
+    const IconAtlas *atlas = nullptr;
+    const BevelMask *bevel_mask = nullptr;
+    DockLens lens;
+    float corner_radius = 12.0f;
+    glm::vec4 bevel_color{0.8f, 0.7f, 0.5f, 0.6f};
+    glm::vec4 background_color{0.1f, 0.1f, 0.1f, 0.85f};
+    float time = 0.0f;  // of the animation clock
+    // The effects that change over time
+    bool shimmer = false;
+    bool hue_border = false;
+};
+
+/**
+ * A framebuffer to draw the dock into: the logical area it shows and its
+ * scale. Scissor boxes are logical, the target maps them to its pixels.
+ */
+class DockTarget
+{
+  public:
+    wlr_box geometry{0, 0, 0, 0};
+    float scale = 1.0f;
+
+    virtual ~DockTarget() = default;
+    virtual void bind() const = 0;
+    virtual void scissor(const wlr_box& box) const = 0;
+};
+
+/** A texture and the framebuffer drawing into it. Needs the GL context. */
+struct CacheBuffer
+{
+    GLuint fb = 0, tex = 0;
+    int width = 0, height = 0;
+
+    /**
+     * Make the texture @w x @h pixels, keeping it if it already is.
+     * Changes the GL_TEXTURE_2D binding of the active texture unit.
+     */
+    void allocate(int w, int h)
+    {
+        if (fb && w == width && h == height) return;
+        if (!fb) {
+            glGenFramebuffers(1, &fb);
+            glGenTextures(1, &tex);
+            glBindTexture(GL_TEXTURE_2D, tex);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindFramebuffer(GL_FRAMEBUFFER, fb);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex, 0);
+        width = w;
+        height = h;
+    }
+
+    void bind() const
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, fb);
+        glViewport(0, 0, width, height);
+    }
+
+    void release()
+    {
+        if (fb) glDeleteFramebuffers(1, &fb);
+        if (tex) glDeleteTextures(1, &tex);
+        fb = tex = 0;
+        width = height = 0;
+    }
+};
+
+/**
+ * The GL side of one dock: the quad and instance buffers, the dock cache
+ * and the draws of a DockScene. Needs the GL context throughout.
+ */
+class DockRenderer
+{
+  public:
+    PassTimer pass_timer;
+    // Draw calls of the last render(), and the pixels they covered
+    int draw_calls = 0;
+    float shaded_pixels = 0.0f;
+
+    bool initialized() const
+    {
+        return vao != 0;
+    }
+
+    /** Create the buffers, with instance space for @capacity icons to begin with. */
+    void init(size_t capacity)
+    {
+        float verts[] = {
+            // pos x, pos y, tex u, tex v (flipped V)
+            0, 0, 0, 1,
+            1, 0, 1, 1,
+            1, 1, 1, 0,
+            0, 1, 0, 0
+        };
+        unsigned int inds[] = {0, 1, 2, 2, 3, 0};
+
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &ebo);
+
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(inds), inds, GL_STATIC_DRAW);
+
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 16, (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 16, (void*)8);
+        glEnableVertexAttribArray(1);
+
+        // Icon VAO: the same quad plus the IconInstances attributes
+        glGenVertexArrays(1, &icon_vao);
+        glGenBuffers(1, &instance_vbo);
+
+        glBindVertexArray(icon_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 16, (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 16, (void*)8);
+        glEnableVertexAttribArray(1);
+
+        glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+        instance_capacity = capacity;
+        glBufferData(GL_ARRAY_BUFFER, instance_buffer_size(), nullptr, GL_DYNAMIC_DRAW);
+        point_instance_attribs(0);
+        for (GLuint loc = 2; loc <= 6; loc++) {
+            glEnableVertexAttribArray(loc);
+            glVertexAttribDivisor(loc, 1);
+        }
+        instances.reserve(capacity);
+        instance_sources.reserve(capacity);
+        instance_of.reserve(capacity);
+        instance_live.reserve(capacity);
+        cache_entries.reserve(capacity);
+        frame_entries.reserve(capacity);
+    }
+
+    void destroy()
+    {
+        if (vao) glDeleteVertexArrays(1, &vao);
+        if (icon_vao) glDeleteVertexArrays(1, &icon_vao);
+        if (vbo) glDeleteBuffers(1, &vbo);
+        if (ebo) glDeleteBuffers(1, &ebo);
+        if (instance_vbo) glDeleteBuffers(1, &instance_vbo);
+        vao = icon_vao = vbo = ebo = instance_vbo = 0;
+        instance_capacity = 0;
+        instances.clear();
+        instance_sources.clear();
+        instance_of.clear();
+        release_cache();
+        pass_timer.destroy();
+    }
+
+    /** Draw the dock cache again on the next render(), its contents changed. */
+    void invalidate_cache()
+    {
+        cache_dirty = true;
+    }
+
+    /** Free the dock cache. */
+    void release_cache()
+    {
+        if (dock_cache.fb) dock_cache.release();
+        cache_entries.clear();
+    }
+
+    /**
+     * Draw @scene clipped to @damage. Only the damaged part of the output
+     * was repainted underneath, so drawing outside of it would blend the
+     * dock over its own retained pixels.
+     *
+     * Unless an effect changes over time, the background and the icons at
+     * rest come from the dock cache, and only icons with a hover animation
+     * go through the shaders. With @measure, the GPU time of both passes
+     * is taken.
+     */
+    void render(const DockPrograms::Variant& shaders, const DockScene& scene, const DockTarget& target,
+                const std::vector<wlr_box>& damage, bool measure)
+    {
+        draw_calls = 0;
+        shaded_pixels = 0.0f;
+        frame_scale = target.scale;
+        if (!scene.layout.count) return;
+
+        // The instances decide what the cache holds, so they come first
+        update_instances(scene);
+
+        const auto& dock = scene.layout.dock;
+        glm::mat4 proj = projection(target.geometry);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        if (measure) pass_timer.begin_frame();
+
+        pass_timer.begin(PassTimer::Background);
+        bool live = scene.shimmer || scene.hue_border;
+        if (live) {
+            release_cache();
+            use_background_program(shaders, scene, proj);
+            for (const auto& area : damage) {
+                target.scissor(area);
+                glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+                count_draw(box_area(box_intersection(area, dock)));
+            }
+            draw_indicators(shaders, scene, proj, Dots::All, &target, &damage);
+        } else {
+            if (!cache_is_current(dock, target)) render_cache(shaders, scene, target);
+
+            // The cache holds premultiplied colors
+            glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+            use_quad(shaders.cache, proj, dock);
+            glUniform1i(shaders.cache.u_texture, 0);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, dock_cache.tex);
+            for (const auto& area : damage) {
+                target.scissor(area);
+                glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+                count_draw(box_area(box_intersection(area, dock)));
+            }
+        }
+        pass_timer.end();
+
+        pass_timer.begin(PassTimer::Icons);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        // The dots of the icons the cache leaves out move with them
+        if (!live) draw_indicators(shaders, scene, proj, Dots::Live, &target, &damage);
+        draw_icons(shaders, scene, proj, target, damage, !live);
+        pass_timer.end();
+        pass_timer.end_frame();
+    }
+
+    /**
+     * Fill @rect, as the output shows it, with @program, clipped to
+     * @damage. For overlays next to the dock of @scene.
+     */
+    void draw_overlay(const ShaderProgram& program, const DockScene& scene, const DockTarget& target,
+                      const std::vector<wlr_box>& damage, const wlr_box& rect)
+    {
+        use_quad(program, projection(target.geometry), scene.layout.mirrored(rect));
+        for (const auto& box : damage) {
+            auto area = box_intersection(box, rect);
+            if (area.width <= 0 || area.height <= 0) continue;
+            target.scissor(area);
+            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        }
+    }
+
+    /** Wayfire's projection (Y down, top-left origin) over @area. */
+    static glm::mat4 projection(const wlr_box& area)
+    {
+        return glm::ortho(
+            (float)area.x,
+            (float)(area.x + area.width),
+            (float)(area.y + area.height),
+            (float)area.y,
+            -1.0f, 1.0f
+        );
+    }
+
+    /**
+     * Put back the state Wayfire and wlroots expect between draws, instead
+     * of querying and restoring it: they bind their own programs and
+     * textures for every draw, but source vertices from client memory, so
+     * no vertex array or buffer may stay bound.
+     */
+    static void reset_gl_state()
+    {
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glUseProgram(0);
+        for (GLenum unit : {GL_TEXTURE2, GL_TEXTURE1, GL_TEXTURE0}) {
+            glActiveTexture(unit);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    }
+
+  private:
+    // Which running indicators a pass draws, see draw_indicators()
+    enum class Dots { All, AtRest, Live };
+
+    GLuint vao = 0, vbo = 0, ebo = 0;
+    GLuint icon_vao = 0, instance_vbo = 0;
+    size_t instance_capacity = 0;
+    IconInstances instances;
+    std::vector<bool> instance_live;  // drawn each frame, not from the cache
+
+    // What the instances were built from, see update_instances()
+    struct InstanceSource
+    {
+        IconState state;
+        AtlasRect rect;
+        bool running;
+
+        bool matches(const DockIcon& icon) const
+        {
+            return state == icon.state && (icon.running > 0) == running && rect.x == icon.atlas_rect.x &&
+                rect.y == icon.atlas_rect.y && rect.width == icon.atlas_rect.width &&
+                rect.height == icon.atlas_rect.height;
+        }
+    };
+    std::vector<InstanceSource> instance_sources;  // one per icon
+    std::vector<int> instance_of;                  // per icon, -1 without one
+    DockLayout instance_layout;
+    int instance_atlas_width = 0, instance_atlas_height = 0;
+    // The icons the lens touched last frame, see apply_lens()
+    int lens_first = 0, lens_last = -1;
+    float frame_scale = 1.0f;
+
+    // The background and the icons at rest, drawn once while nothing on
+    // them changes over time. The entries say what each icon looked like,
+    // see update_instances().
+    CacheBuffer dock_cache;
+    std::vector<int> cache_entries, frame_entries;
+    bool cache_dirty = false;
+
+    /** Note a draw call covering @area logical pixels, for the frame stats. */
+    void count_draw(double area)
+    {
+        draw_calls++;
+        shaded_pixels += area * frame_scale * frame_scale;
+    }
+
+    // Byte offsets of the attribute arrays in the instance buffer, which
+    // has room for instance_capacity instances in each
+    size_t hover_block() const { return instance_capacity * sizeof(glm::vec2); }
+    size_t uv_block() const { return hover_block() + instance_capacity * sizeof(float); }
+    size_t running_block() const { return uv_block() + instance_capacity * sizeof(glm::vec4); }
+    size_t scale_block() const { return running_block() + instance_capacity * sizeof(float); }
+    size_t instance_buffer_size() const { return scale_block() + instance_capacity * sizeof(float); }
+
+    /**
+     * Source the per-instance attributes from instance @first on. GLES has
+     * no base instance, so drawing a sub-range moves the pointers instead.
+     * Needs icon_vao and instance_vbo bound.
+     */
+    void point_instance_attribs(size_t first) const
+    {
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (void*)(first * sizeof(glm::vec2)));
+        glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, 0, (void*)(hover_block() + first * sizeof(float)));
+        glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, 0, (void*)(uv_block() + first * sizeof(glm::vec4)));
+        glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, 0, (void*)(running_block() + first * sizeof(float)));
+        glVertexAttribPointer(6, 1, GL_FLOAT, GL_FALSE, 0, (void*)(scale_block() + first * sizeof(float)));
+    }
+
+    /** Bind @shader_program and the quad, placed over @rect. */
+    void use_quad(const ShaderProgram& shader_program, const glm::mat4& proj, const wlr_box& rect)
+    {
+        glUseProgram(shader_program.program);
+        glm::mat4 model = glm::translate(glm::mat4(1), glm::vec3(rect.x, rect.y, 0));
+        model = glm::scale(model, glm::vec3(rect.width, rect.height, 1));
+        glm::mat4 mvp = proj * model;
+        glUniformMatrix4fv(shader_program.u_mvp, 1, GL_FALSE, glm::value_ptr(mvp));
+        glBindVertexArray(vao);
+    }
+
+    void use_background_program(const DockPrograms::Variant& shaders, const DockScene& scene, const glm::mat4& proj)
+    {
+        const auto& dock = scene.layout.dock;
+        use_quad(shaders.background, proj, dock);
+        glUniform2f(shaders.background.u_resolution, dock.width, dock.height);
+        glUniform1f(shaders.background.u_corner_radius, scene.corner_radius + 4);
+        glUniform4fv(shaders.background.u_background_color, 1, glm::value_ptr(scene.background_color));
+        glUniform1f(shaders.background.u_time, scene.hue_border ? scene.time : 0.0f);
+    }
+
+    void use_icon_program(const DockPrograms::Variant& shaders, const DockScene& scene, const glm::mat4& proj)
+    {
+        float shimmer_time = scene.shimmer ? scene.time : 0.0f;
+        float icon_size = scene.layout.icon_size;
+
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, scene.bevel_mask->shading);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, scene.bevel_mask->distance);
+
+        glUseProgram(shaders.icon.program);
+        glUniformMatrix4fv(shaders.icon.u_mvp, 1, GL_FALSE, glm::value_ptr(proj));
+        glUniform1i(shaders.icon.u_texture, 0);
+        glUniform1i(shaders.icon.u_bevel_shading, 1);
+        glUniform1i(shaders.icon.u_bevel_distance, 2);
+        glUniform2f(shaders.icon.u_resolution, icon_size, icon_size);
+        glUniform4fv(shaders.icon.u_bevel_color, 1, glm::value_ptr(scene.bevel_color));
+        glUniform1f(shaders.icon.u_time, scene.time);
+        glUniform1f(shaders.icon.u_shimmer_time, shimmer_time);
+        glUniform2f(shaders.icon.u_highlight_phase,
+                    std::cos(shimmer_time * 2.5f), std::sin(shimmer_time * 2.5f));
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, scene.atlas->texture);
+        glBindVertexArray(icon_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+    }
+
+    /**
+     * Draw the running indicators of all icons, or of just those in the dock
+     * cache or just those that are not, scissored to @target's @damage in
+     * the dock if given.
+     */
+    void draw_indicators(const DockPrograms::Variant& shaders, const DockScene& scene, const glm::mat4& proj,
+                         Dots which, const DockTarget *target, const std::vector<wlr_box> *damage)
+    {
+        const auto& layout = scene.layout;
+        auto drawn = [&] (size_t k) { return which == Dots::All || instance_live[k] == (which == Dots::Live); };
+        int dots = 0;
+        for (size_t k = 0; k < instances.size(); k++) dots += drawn(k) && instances.running[k] == 1.0f;
+        if (!dots) return;
+
+        float radius = std::clamp(layout.margin * 0.25f, 1.0f, 3.0f);
+        glUseProgram(shaders.indicator.program);
+        glUniformMatrix4fv(shaders.indicator.u_mvp, 1, GL_FALSE, glm::value_ptr(proj));
+        glUniform3f(shaders.indicator.u_indicator, -layout.margin * 0.5f, layout.icon_size * 0.5f, radius);
+        glBindVertexArray(icon_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+        auto draw_runs = [&] {
+            for (size_t k = 0; k < instances.size();) {
+                if (!drawn(k)) {
+                    k++;
+                    continue;
+                }
+                size_t first = k;
+                while (k < instances.size() && drawn(k)) k++;
+                point_instance_attribs(first);
+                glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, k - first);
+            }
+        };
+        if (!damage) {
+            draw_runs();
+            count_draw(dots * 4 * radius * radius);
+            return;
+        }
+        for (const auto& box : *damage) {
+            // The dots of icons scrolled halfway out stay in the dock
+            auto area = box_intersection(box, layout.dock);
+            if (area.width <= 0 || area.height <= 0) continue;
+            target->scissor(area);
+            draw_runs();
+            count_draw(std::min(box_area(area), (double)dots * 4 * radius * radius));
+        }
+    }
+
+    /**
+     * Draw the icons touching @damage, or with @live_only just those that
+     * are not in the dock cache. Icons are laid out vertically, so all of
+     * them are one instanced draw per damage box over just the icons it
+     * touches, scissored to where they can draw. Live icons are few, and
+     * are drawn one by one.
+     */
+    void draw_icons(const DockPrograms::Variant& shaders, const DockScene& scene, const glm::mat4& proj,
+                    const DockTarget& target, const std::vector<wlr_box>& damage, bool live_only)
+    {
+        if (instances.empty()) return;
+        if (live_only && std::find(instance_live.begin(), instance_live.end(), true) == instance_live.end())
+            return;
+
+        use_icon_program(shaders, scene, proj);
+        for (const auto& area : damage) {
+            if (live_only) {
+                for (size_t k = 0; k < instances.size(); k++) {
+                    auto hit = box_intersection(area, instances.bounds[k]);
+                    if (!instance_live[k] || hit.width <= 0 || hit.height <= 0) continue;
+                    point_instance_attribs(k);
+                    target.scissor(hit);
+                    glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, 1);
+                    count_draw(box_area(hit));
+                }
+                continue;
+            }
+
+            int first = -1, last = -1;
+            int x1 = INT_MAX, y1 = INT_MAX, x2 = INT_MIN, y2 = INT_MIN;
+            double covered = 0.0;
+            for (size_t k = 0; k < instances.size(); k++) {
+                auto hit = box_intersection(area, instances.bounds[k]);
+                if (hit.width <= 0 || hit.height <= 0) continue;
+                if (first < 0) first = k;
+                last = k;
+                covered += box_area(hit);
+                x1 = std::min(x1, hit.x);
+                y1 = std::min(y1, hit.y);
+                x2 = std::max(x2, hit.x + hit.width);
+                y2 = std::max(y2, hit.y + hit.height);
+            }
+            if (first < 0) continue;
+
+            point_instance_attribs(first);
+            target.scissor({x1, y1, x2 - x1, y2 - y1});
+            glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, last - first + 1);
+            count_draw(covered);
+        }
+    }
+
+    /** Dock cache size in pixels for @target. */
+    static void cache_size(const wlr_box& dock, const DockTarget& target, int& width, int& height)
+    {
+        width = (int)std::ceil(dock.width * target.scale);
+        height = (int)std::ceil(dock.height * target.scale);
+    }
+
+    bool cache_is_current(const wlr_box& dock, const DockTarget& target) const
+    {
+        int width, height;
+        cache_size(dock, target, width, height);
+        return dock_cache.fb && !cache_dirty && dock_cache.width == width &&
+            dock_cache.height == height && cache_entries == frame_entries;
+    }
+
+    /**
+     * Redraw the dock cache: the background and every icon at rest, in
+     * dock-local coordinates so that sliding the dock keeps it valid. Leaves
+     * @target bound again.
+     */
+    void render_cache(const DockPrograms::Variant& shaders, const DockScene& scene, const DockTarget& target)
+    {
+        const auto& dock = scene.layout.dock;
+        int width, height;
+        cache_size(dock, target, width, height);
+        dock_cache.allocate(width, height);
+        dock_cache.bind();
+        glDisable(GL_SCISSOR_TEST);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        // Blend as usual, but accumulate premultiplied colors and alpha
+        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        glm::mat4 proj = projection(dock);
+        use_background_program(shaders, scene, proj);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        count_draw(box_area(dock));
+        draw_indicators(shaders, scene, proj, Dots::AtRest, nullptr, nullptr);
+
+        if (!instances.empty()) {
+            use_icon_program(shaders, scene, proj);
+            for (size_t k = 0; k < instances.size();) {
+                if (instance_live[k]) {
+                    k++;
+                    continue;
+                }
+                size_t first = k;
+                double covered = 0.0;
+                for (; k < instances.size() && !instance_live[k]; k++) covered += box_area(instances.bounds[k]);
+                point_instance_attribs(first);
+                glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, k - first);
+                count_draw(covered);
+            }
+        }
+
+        target.bind();
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        cache_entries = frame_entries;
+        cache_dirty = false;
+    }
+
+    /**
+     * Bring the instances up to date with @scene, and note which icons the
+     * dock cache would hold. They are laid out again only when the layout,
+     * the atlas size or an icon's image changed: each other frame rewrites
+     * the hover values and the icons under the lens, and nothing else.
+     */
+    void update_instances(const DockScene& scene)
+    {
+        const auto& layout = scene.layout;
+        bool current = instance_sources.size() == (size_t)layout.count && layout == instance_layout &&
+            scene.atlas->width == instance_atlas_width && scene.atlas->height == instance_atlas_height;
+        for (int i = 0; current && i < layout.count; i++)
+            current = instance_sources[i].matches(scene.icons[i]);
+        if (!current) build_instances(scene);
+        apply_lens(scene);
+
+        instance_live.clear();
+        frame_entries.assign(layout.count, 0);
+        for (size_t k = 0; k < instances.size(); k++) {
+            const auto& icon = scene.icons[instances.icon[k]];
+            instances.hover[k] = icon.hover;
+            // Icons at rest look the same in every frame
+            bool at_rest = icon.hover == 0.0f && instances.scale[k] == 1.0f;
+            instance_live.push_back(!at_rest);
+            if (at_rest) frame_entries[instances.icon[k]] = 1 + (int)icon.state;
+        }
+        if (instances.empty()) return;
+
+        glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+        glBufferSubData(GL_ARRAY_BUFFER, hover_block(), instances.size() * sizeof(float), instances.hover.data());
+    }
+
+    /** Lay out the instances of @scene's icons, everything but the hover values. */
+    void build_instances(const DockScene& scene)
+    {
+        const auto& layout = scene.layout;
+        instances.clear();
+        instance_sources.clear();
+        instance_of.assign(layout.count, -1);
+        // Everything is back at rest, apply_lens() grows what it needs to
+        lens_first = 0;
+        lens_last = -1;
+        for (int i = 0; i < layout.count; i++) {
+            const auto& icon = scene.icons[i];
+            instance_sources.push_back({icon.state, icon.atlas_rect, icon.running > 0});
+
+            // Icons scrolled out of the dock are culled here already
+            auto shown = box_intersection(layout.icon_bounds(i), layout.dock);
+            bool drawn = (icon.state == IconState::Ready || icon.state == IconState::Loading) &&
+                shown.width > 0 && shown.height > 0;
+            if (!drawn) continue;
+
+            auto rect = layout.mirrored(layout.icon_rect(i));
+            glm::vec4 uv(0.0f);  // the placeholder, until the decode finishes
+            if (icon.state == IconState::Ready)
+                scene.atlas->uv_rect(icon.atlas_rect, uv.x, uv.y, uv.z, uv.w);
+            instance_of[i] = instances.size();
+            instances.offset.emplace_back(rect.x, rect.y);
+            instances.hover.push_back(icon.hover);
+            instances.uv.push_back(uv);
+            instances.running.push_back(icon.running > 0 ? 1.0f : 0.0f);
+            instances.scale.push_back(1.0f);
+            instances.bounds.push_back(shown);
+            instances.icon.push_back(i);
+        }
+        instance_layout = layout;
+        instance_atlas_width = scene.atlas->width;
+        instance_atlas_height = scene.atlas->height;
+
+        glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+        if (instances.size() > instance_capacity) {
+            // Apps were added since
+            instance_capacity = instances.size();
+            glBufferData(GL_ARRAY_BUFFER, instance_buffer_size(), nullptr, GL_DYNAMIC_DRAW);
+        }
+        size_t count = instances.size();
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::vec2), instances.offset.data());
+        glBufferSubData(GL_ARRAY_BUFFER, uv_block(), count * sizeof(glm::vec4), instances.uv.data());
+        glBufferSubData(GL_ARRAY_BUFFER, running_block(), count * sizeof(float), instances.running.data());
+        glBufferSubData(GL_ARRAY_BUFFER, scale_block(), count * sizeof(float), instances.scale.data());
+    }
+
+    /**
+     * Move and grow the instances under @scene's lens, and put back the
+     * ones it left since the last frame. Only the icons in those two spans
+     * are touched, and only their range of the buffer is uploaded.
+     */
+    void apply_lens(const DockScene& scene)
+    {
+        const auto& layout = scene.layout;
+        int first = 0, last = -1;
+        layout.lens_span(scene.lens, first, last);
+
+        size_t low = SIZE_MAX, high = 0;
+        auto place = [&] (int i) {
+            int k = instance_of[i];
+            if (k < 0) return;
+
+            float top, scale;
+            layout.magnify(i, scene.lens, top, scale);
+            auto rect = layout.icon_rect(i);
+            // Drawn mirrored, see DockLayout::mirrored()
+            instances.offset[k] = {(float)rect.x, 2.0f * layout.dock.y + layout.dock.height - top - rect.height * scale};
+            instances.scale[k] = scale;
+            // Grown icons reach out of the dock, but not past its ends
+            auto bounds = layout.magnified_bounds(i, scene.lens);
+            instances.bounds[k] = box_intersection(bounds, scale == 1.0f ? layout.dock :
+                                                   wlr_box{bounds.x, layout.dock.y, bounds.width, layout.dock.height});
+            low = std::min(low, (size_t)k);
+            high = std::max(high, (size_t)k);
+        };
+        for (int i = lens_first; i <= lens_last; i++) place(i);
+        for (int i = first; i <= last; i++) place(i);
+        lens_first = first;
+        lens_last = last;
+        if (low > high) return;
+
+        size_t count = high - low + 1;
+        glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+        glBufferSubData(GL_ARRAY_BUFFER, low * sizeof(glm::vec2), count * sizeof(glm::vec2), &instances.offset[low]);
+        glBufferSubData(GL_ARRAY_BUFFER, scale_block() + low * sizeof(float), count * sizeof(float),
+                        &instances.scale[low]);
+    }
+};
+
+} // namespace shader_dock
@@ -2,7 +2,7 @@
  * Wayfire Shader Dock Plugin
  * 
  * A dock/panel plugin that renders application icons with bevel/shimmer/3D effects.
- * Uses custom OpenGL shaders rendered directly to output framebuffer.
+ * Uses custom OpenGL shaders, drawn by a scene graph node in each output's top layer.
  */
 
 #include <wayfire/plugin.hpp>
@@ -12,768 +12,2649 @@
 #include <wayfire/output-layout.hpp>
 #include <wayfire/render-manager.hpp>
 #include <wayfire/opengl.hpp>
+#include <wayfire/region.hpp>
+#include <wayfire/scene.hpp>
+#include <wayfire/scene-render.hpp>
+#include <wayfire/scene-operations.hpp>
 #include <wayfire/signal-definitions.hpp>
+#include <wayfire/toplevel-view.hpp>
+#include <wayfire/window-manager.hpp>
+#include <wayfire/seat.hpp>
 #include <wayfire/nonstd/wlroots-full.hpp>
 #include <wayfire/util/log.hpp>
 #include <wayfire/util.hpp>
+#include <wayfire/plugins/common/shared-core-data.hpp>
 
 #include <GLES3/gl3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+#include <cinttypes>
+#include <climits>
 #include <fstream>
 #include <sstream>
 #include <filesystem>
 #include <chrono>
 #include <cmath>
+#include <utility>
 
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#include <spawn.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <dirent.h>
 #include <png.h>
 #include <linux/input-event-codes.h>
 
+#include "dock-renderer.hpp"
+
 extern char **environ;
 
 namespace shader_dock
 {
 
-// ============================================================================
-// Shader Sources
-// ============================================================================
-
-static const char* vertex_shader_src = R"(#version 300 es
-precision highp float;
-layout(location = 0) in vec2 a_position;
-layout(location = 1) in vec2 a_texcoord;
-out vec2 v_texcoord;
-uniform mat4 u_mvp;
-void main() {
-    gl_Position = u_mvp * vec4(a_position, 0.0, 1.0);
-    v_texcoord = a_texcoord;
-}
-)";
-
-static const char* icon_fragment_shader_src = R"(#version 300 es
-precision highp float;
-in vec2 v_texcoord;
-out vec4 frag_color;
-
-uniform sampler2D u_texture;
-uniform vec2 iResolution;
-uniform float cornerRadius;
-uniform vec4 bevelColor;
-uniform float time;
-uniform float hover;
-
-const float bevelWidth = 12.0;
-const float aa = 1.5;
-
-float sdRoundedBox(vec2 p, vec2 b, float r) {
-    vec2 q = abs(p) - b + r;
-    return min(max(q.x, q.y), 0.0) + length(max(q, 0.0)) - r;
-}
-
-void main() {
-    float bounce = 1.0 + hover * (sin(time * 6.0) * 0.05 + 0.08);
-    
-    vec2 p = (v_texcoord - 0.5) * iResolution;
-    float scaledCornerRadius = cornerRadius * bounce;
-    float d = sdRoundedBox(p, iResolution * 0.5 * bounce, scaledCornerRadius);
-    float shape_alpha = 1.0 - smoothstep(-aa, aa, d);
-    float bevel_intensity = smoothstep(-bevelWidth, 0.0, d) - smoothstep(0.0, aa, d);
-    
-    float center_distance = length(p) / (min(iResolution.x, iResolution.y) * 0.5);
-    float button_height = pow(1.0 - smoothstep(0.0, 0.8, center_distance), 2.0);
-    
-    vec2 light_dir = normalize(vec2(-1.0, -1.0));
-    float button_lighting = 0.5 + dot(normalize(p), light_dir) * 0.3 * button_height;
-    
-    float combined_bevel = max(bevel_intensity, button_height * 0.4);
-    float angle = atan(p.y, p.x);
-    float highlight_factor = pow(sin(angle * 2.0 - time * 2.5) * 0.5 + 0.5, 8.0);
-    float brightness = (0.7 + highlight_factor * 0.6) * button_lighting;
-    
-    float shimmer = sin((p.x + p.y) / (iResolution.x + iResolution.y) * 8.0 + time * 4.0);
-    float shimmer_intensity = smoothstep(0.6, 1.0, shimmer) * 0.3 * 
-                              smoothstep(-bevelWidth * 0.5, bevelWidth * 0.5, -abs(d));
-    
-    vec2 scaled_uv = clamp((v_texcoord - 0.5) / bounce + 0.5, 0.0, 1.0);
-    vec4 tex_color = texture(u_texture, scaled_uv);
-    
-    vec3 bevel_col = mix(bevelColor.rgb * brightness, vec3(1.0, 1.0, 0.9), shimmer_intensity);
-    vec3 final_rgb = mix(tex_color.rgb, bevel_col, combined_bevel * bevelColor.a);
-    final_rgb += vec3(0.2, 0.15, 0.1) * hover * (1.0 - center_distance);
-    
-    frag_color = vec4(final_rgb, tex_color.a * shape_alpha);
-}
-)";
-
-static const char* background_fragment_shader_src = R"(#version 300 es
-precision highp float;
-in vec2 v_texcoord;
-out vec4 frag_color;
-
-uniform vec2 iResolution;
-uniform float cornerRadius;
-uniform vec4 backgroundColor;
-uniform float time;
-
-float sdRoundedBox(vec2 p, vec2 b, float r) {
-    vec2 q = abs(p) - b + r;
-    return min(max(q.x, q.y), 0.0) + length(max(q, 0.0)) - r;
-}
-
-vec3 hsv2rgb(vec3 c) {
-    vec4 K = vec4(1.0, 2.0 / 3.0, 1.0 / 3.0, 3.0);
-    vec3 p = abs(fract(c.xxx + K.xyz) * 6.0 - K.www);
-    return c.z * mix(K.xxx, clamp(p - K.xxx, 0.0, 1.0), c.y);
-}
-
-void main() {
-    vec2 p = (v_texcoord - 0.5) * iResolution;
-    float d = sdRoundedBox(p, iResolution * 0.5, cornerRadius);
-    
-    float aa = 1.5;
-    float shape_alpha = 1.0 - smoothstep(-aa, aa, d);
-    float border = smoothstep(-3.0, 0.0, d) - smoothstep(0.0, aa, d);
-    
-    float hue = fract((v_texcoord.x + v_texcoord.y) * 0.5 - time * 0.1);
-    vec3 border_color = hsv2rgb(vec3(hue, 0.8, 1.0));
-    
-    vec3 final_color = mix(backgroundColor.rgb, border_color, border * 0.8);
-    frag_color = vec4(final_color, backgroundColor.a * shape_alpha);
-}
-)";
-
 // ============================================================================
 // Structures
 // ============================================================================
 
-struct DockIcon
+// The keys of a .desktop file the dock uses
+struct DesktopEntry
 {
-    std::string app_id;
+    std::string path;
     std::string name;
-    std::string exec;
-    std::string icon_path;
-    GLuint texture_id = 0;
-    int width = 0;
-    int height = 0;
-    float hover = 0.0f;
-    bool texture_loaded = false;
-};
-
-class ShaderProgram
-{
-  public:
-    GLuint program = 0;
-    GLint u_mvp = -1;
-    GLint u_texture = -1;
-    GLint u_resolution = -1;
-    GLint u_corner_radius = -1;
-    GLint u_bevel_color = -1;
-    GLint u_background_color = -1;
-    GLint u_time = -1;
-    GLint u_hover = -1;
-
-    bool compile(const char* vert_src, const char* frag_src)
-    {
-        GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vs, 1, &vert_src, nullptr);
-        glCompileShader(vs);
-        
-        GLint success;
-        glGetShaderiv(vs, GL_COMPILE_STATUS, &success);
-        if (!success) {
-            char log[512];
-            glGetShaderInfoLog(vs, 512, nullptr, log);
-            LOGD("VS compile error: ", log);
-            glDeleteShader(vs);
-            return false;
-        }
-
-        GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fs, 1, &frag_src, nullptr);
-        glCompileShader(fs);
-        
-        glGetShaderiv(fs, GL_COMPILE_STATUS, &success);
-        if (!success) {
-            char log[512];
-            glGetShaderInfoLog(fs, 512, nullptr, log);
-            LOGD("FS compile error: ", log);
-            glDeleteShader(vs);
-            glDeleteShader(fs);
-            return false;
-        }
-
-        program = glCreateProgram();
-        glAttachShader(program, vs);
-        glAttachShader(program, fs);
-        glLinkProgram(program);
-        
-        glDeleteShader(vs);
-        glDeleteShader(fs);
-
-        glGetProgramiv(program, GL_LINK_STATUS, &success);
-        if (!success) {
-            char log[512];
-            glGetProgramInfoLog(program, 512, nullptr, log);
-            LOGD("Program link error: ", log);
-            glDeleteProgram(program);
-            program = 0;
-            return false;
-        }
-
-        u_mvp = glGetUniformLocation(program, "u_mvp");
-        u_texture = glGetUniformLocation(program, "u_texture");
-        u_resolution = glGetUniformLocation(program, "iResolution");
-        u_corner_radius = glGetUniformLocation(program, "cornerRadius");
-        u_bevel_color = glGetUniformLocation(program, "bevelColor");
-        u_background_color = glGetUniformLocation(program, "backgroundColor");
-        u_time = glGetUniformLocation(program, "time");
-        u_hover = glGetUniformLocation(program, "hover");
-
-        return true;
-    }
-
-    void destroy()
-    {
-        if (program) {
-            glDeleteProgram(program);
-            program = 0;
-        }
-    }
+    std::string exec;  // with the string escapes undone
+    std::string icon;
+    bool hidden = false;
 };
 
 // ============================================================================
-// Helper Functions
+// Icon Cache
 // ============================================================================
 
-bool load_png_texture(const std::string& path, GLuint& texture_id, int& width, int& height)
-{
-    FILE* fp = fopen(path.c_str(), "rb");
-    if (!fp) return false;
-
-    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
-    if (!png) { fclose(fp); return false; }
-
-    png_infop info = png_create_info_struct(png);
-    if (!info) { png_destroy_read_struct(&png, nullptr, nullptr); fclose(fp); return false; }
-
-    if (setjmp(png_jmpbuf(png))) {
-        png_destroy_read_struct(&png, &info, nullptr);
-        fclose(fp);
-        return false;
-    }
-
-    png_init_io(png, fp);
-    png_read_info(png, info);
-
-    width = png_get_image_width(png, info);
-    height = png_get_image_height(png, info);
-    png_byte color_type = png_get_color_type(png, info);
-    png_byte bit_depth = png_get_bit_depth(png, info);
-
-    if (bit_depth == 16) png_set_strip_16(png);
-    if (color_type == PNG_COLOR_TYPE_PALETTE) png_set_palette_to_rgb(png);
-    if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8) png_set_expand_gray_1_2_4_to_8(png);
-    if (png_get_valid(png, info, PNG_INFO_tRNS)) png_set_tRNS_to_alpha(png);
-    if (color_type == PNG_COLOR_TYPE_RGB || color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_PALETTE)
-        png_set_filler(png, 0xFF, PNG_FILLER_AFTER);
-    if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
-        png_set_gray_to_rgb(png);
-
-    png_read_update_info(png, info);
-
-    std::vector<png_bytep> row_pointers(height);
-    std::vector<png_byte> image_data(width * height * 4);
-    for (int y = 0; y < height; y++)
-        row_pointers[y] = image_data.data() + y * width * 4;
+/*
+ * Decoded and scaled icons are kept under $XDG_CACHE_HOME/shader-dock/icons
+ * as raw RGBA, keyed by source path, source mtime and pixel size. A warm
+ * start maps these files instead of running libpng and the scaler. Size 0
+ * is the decoded source itself, which a new pixel size is scaled from.
+ */
 
-    png_read_image(png, row_pointers.data());
-    png_destroy_read_struct(&png, &info, nullptr);
-    fclose(fp);
+static constexpr uint32_t icon_cache_version = 1;
 
-    // Save current texture binding
-    GLint prev_texture;
-    glGetIntegerv(GL_TEXTURE_BINDING_2D, &prev_texture);
+struct IconCacheHeader
+{
+    char magic[4];  // "SDIC"
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t size;  // requested pixel size
+    uint32_t path_length;
+    int64_t mtime_ns;
+    // followed by the source path, then the pixels at pixel_offset()
+};
 
-    glGenTextures(1, &texture_id);
-    glBindTexture(GL_TEXTURE_2D, texture_id);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image_data.data());
+static size_t icon_cache_pixel_offset(uint32_t path_length)
+{
+    return (sizeof(IconCacheHeader) + path_length + 15) & ~(size_t)15;
+}
 
-    // Restore previous texture binding
-    glBindTexture(GL_TEXTURE_2D, prev_texture);
+static std::string icon_cache_file(const std::string& path, int64_t mtime_ns, int size)
+{
+    CacheKey key;
+    key.mix(path.data(), path.size());
+    key.mix(&mtime_ns, sizeof(mtime_ns));
+    key.mix(&size, sizeof(size));
+    return cache_base_dir() + "/icons/" + key.hex() + ".rgba";
+}
 
+static bool source_mtime(const std::string& path, int64_t& mtime_ns)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
     return true;
 }
 
-std::string find_icon_path(const std::string& icon_name, [[maybe_unused]] int size)
+/** Map the cached copy of @path at @size, if there is a valid one. */
+bool load_cached_icon(const std::string& path, int64_t mtime_ns, int size,
+                      std::shared_ptr<MappedFile>& out, const uint8_t*& pixels,
+                      int& width, int& height)
 {
-    std::vector<std::string> theme_dirs = {
-        "/usr/share/icons/hicolor",
-        "/usr/share/icons/Adwaita", 
-        "/usr/share/icons/breeze",
-        "/usr/share/icons/Papirus"
-    };
-    std::vector<std::string> sizes = {"256x256", "128x128", "96x96", "64x64", "48x48"};
-    std::vector<std::string> cats = {"apps", "applications"};
-
-    if (icon_name.find('/') != std::string::npos && std::filesystem::exists(icon_name))
-        return icon_name;
-
-    for (const auto& theme : theme_dirs)
-        for (const auto& sz : sizes)
-            for (const auto& cat : cats) {
-                std::string path = theme + "/" + sz + "/" + cat + "/" + icon_name + ".png";
-                if (std::filesystem::exists(path)) return path;
-            }
+    // Populate here: the worker takes the page faults, not the GL thread
+    auto file = map_file(icon_cache_file(path, mtime_ns, size), true);
+    if (!file || file->length < sizeof(IconCacheHeader)) return false;
+
+    auto hdr = (const IconCacheHeader*)file->bytes();
+    size_t offset = icon_cache_pixel_offset(hdr->path_length);
+    if (std::memcmp(hdr->magic, "SDIC", 4) != 0 || hdr->version != icon_cache_version ||
+        hdr->size != (uint32_t)size || hdr->mtime_ns != mtime_ns ||
+        hdr->path_length != path.size() ||
+        file->length < offset + (size_t)hdr->width * hdr->height * 4 ||
+        std::memcmp(hdr + 1, path.data(), path.size()) != 0)
+        return false;
 
-    std::string pixmap = "/usr/share/pixmaps/" + icon_name + ".png";
-    if (std::filesystem::exists(pixmap)) return pixmap;
-    return "";
+    pixels = file->bytes() + offset;
+    width = hdr->width;
+    height = hdr->height;
+    out = std::move(file);
+    return true;
 }
 
-bool parse_desktop_file(const std::string& app_id, DockIcon& icon)
+/** Write a scaled icon to the cache. Failures only cost the next start. */
+void store_cached_icon(const std::string& path, int64_t mtime_ns, int size,
+                       const std::vector<uint8_t>& pixels, int width, int height)
 {
-    std::vector<std::string> paths = {
-        "/usr/share/applications/",
-        "/usr/local/share/applications/",
-        std::string(getenv("HOME") ? getenv("HOME") : "") + "/.local/share/applications/"
-    };
+    IconCacheHeader hdr;
+    std::memcpy(hdr.magic, "SDIC", 4);
+    hdr.version = icon_cache_version;
+    hdr.width = width;
+    hdr.height = height;
+    hdr.size = size;
+    hdr.path_length = path.size();
+    hdr.mtime_ns = mtime_ns;
+
+    std::vector<uint8_t> padding(icon_cache_pixel_offset(hdr.path_length) - sizeof(hdr) - path.size(), 0);
+    write_cache_file(icon_cache_file(path, mtime_ns, size), {
+        {&hdr, sizeof(hdr)},
+        {path.data(), path.size()},
+        {padding.data(), padding.size()},
+        {pixels.data(), pixels.size()},
+    });
+}
 
-    std::string desktop_file;
-    for (const auto& p : paths) {
-        std::string full = p + app_id + ".desktop";
-        if (std::filesystem::exists(full)) { desktop_file = full; break; }
+/** Undo the escapes of desktop entry string values (\s, \n, \t, \r, \\). */
+static std::string unescape_desktop_string(const std::string& value)
+{
+    std::string out;
+    out.reserve(value.size());
+    for (size_t i = 0; i < value.size(); i++) {
+        if (value[i] != '\\' || i + 1 == value.size()) {
+            out += value[i];
+            continue;
+        }
+        switch (value[++i]) {
+          case 's':  out += ' '; break;
+          case 'n':  out += '\n'; break;
+          case 't':  out += '\t'; break;
+          case 'r':  out += '\r'; break;
+          case '\\': out += '\\'; break;
+          // Exec quoting escapes, left for split_exec()
+          default:   out += '\\'; out += value[i]; break;
+        }
     }
-    if (desktop_file.empty()) return false;
+    return out;
+}
 
-    std::ifstream file(desktop_file);
-    if (!file.is_open()) return false;
+/**
+ * Read the [Desktop Entry] group of @path into @entry, straight from a
+ * mapping of the file. Returns whether the file exists.
+ */
+bool parse_desktop_entry(const std::string& path, DesktopEntry& entry)
+{
+    auto file = map_file(path, false);
+    if (!file) return false;
 
-    std::string line;
+    std::string_view text((const char*)file->bytes(), file->length);
     bool in_entry = false;
-    while (std::getline(file, line)) {
+    while (!text.empty()) {
+        size_t eol = text.find('\n');
+        std::string_view line = text.substr(0, eol);
+        text.remove_prefix(eol == std::string_view::npos ? text.size() : eol + 1);
+
         size_t start = line.find_first_not_of(" \t");
-        if (start == std::string::npos) continue;
-        line = line.substr(start);
-        if (line.empty() || line[0] == '#') continue;
-        if (line[0] == '[') { in_entry = (line == "[Desktop Entry]"); continue; }
+        if (start == std::string_view::npos) continue;
+        line.remove_prefix(start);
+        if (line[0] == '#') continue;
+        if (line[0] == '[') {
+            // [Desktop Entry] comes first, the groups after it are not needed
+            if (in_entry) break;
+            in_entry = line.substr(0, line.find_last_not_of(" \t\r") + 1) == "[Desktop Entry]";
+            continue;
+        }
         if (!in_entry) continue;
 
         size_t eq = line.find('=');
-        if (eq == std::string::npos) continue;
-        std::string key = line.substr(0, eq);
-        std::string val = line.substr(eq + 1);
-        
-        // Trim
-        key.erase(key.find_last_not_of(" \t") + 1);
+        if (eq == std::string_view::npos) continue;
+        std::string_view key = line.substr(0, eq);
+        std::string_view val = line.substr(eq + 1);
+        key = key.substr(0, key.find_last_not_of(" \t") + 1);
         size_t vs = val.find_first_not_of(" \t");
-        if (vs != std::string::npos) val = val.substr(vs);
+        val = vs == std::string_view::npos ? std::string_view{} : val.substr(vs);
+        val = val.substr(0, val.find_last_not_of(" \t\r") + 1);
 
-        if (key == "Name") icon.name = val;
-        else if (key == "Exec") {
-            size_t pos;
-            while ((pos = val.find('%')) != std::string::npos)
-                val.erase(pos, pos + 1 < val.size() ? 2 : 1);
-            val.erase(val.find_last_not_of(" \t") + 1);
-            icon.exec = val;
-        }
-        else if (key == "Icon") icon.icon_path = val;
+        if (key == "Name") entry.name = val;
+        else if (key == "Exec") entry.exec = unescape_desktop_string(std::string(val));
+        else if (key == "Icon") entry.icon = val;
+        else if (key == "Hidden") entry.hidden = val == "true";
     }
-    icon.app_id = app_id;
-    return !icon.exec.empty();
+    entry.path = path;
+    return true;
 }
 
-void launch_application(const std::string& exec_cmd)
+/** Fill in @icon for @app_id from its desktop entry. */
+bool dock_icon_from_entry(const std::string& app_id, const DesktopEntry& entry, DockIcon& icon)
 {
-    LOGD("shader-dock: launching '", exec_cmd, "'");
-    
-    pid_t pid = fork();
-    if (pid == 0) {
-        // Child process
-        // Detach from parent process group
-        setsid();
-        
-        // Close file descriptors
-        for (int fd = 3; fd < 256; fd++) {
-            close(fd);
-        }
-        
-        // Execute via shell for proper parsing
-        execl("/bin/sh", "sh", "-c", exec_cmd.c_str(), nullptr);
-        
-        // If exec fails, exit child
-        _exit(127);
-    } else if (pid > 0) {
-        // Parent - don't wait, let the child run independently
-        LOGD("shader-dock: spawned process ", pid);
-    } else {
-        LOGD("shader-dock: fork failed");
+    icon.app_id = app_id;
+    icon.name = entry.name;
+    icon.exec = entry.exec;
+    icon.icon_name = entry.icon;
+
+    if (!split_exec(icon.exec, icon, entry.path, icon.argv)) {
+        LOGD("shader-dock: ", app_id, " needs a shell to run '", icon.exec, "'");
+        size_t pos;
+        while ((pos = icon.exec.find('%')) != std::string::npos)
+            icon.exec.erase(pos, pos + 1 < icon.exec.size() ? 2 : 1);
+        icon.exec.erase(icon.exec.find_last_not_of(" \t") + 1);
     }
+    return !icon.exec.empty();
 }
 
 // ============================================================================
-// Main Plugin
+// Shared Resources
 // ============================================================================
 
-class ShaderDockPlugin : public wf::per_output_plugin_instance_t
+/** Milliseconds since @start, for frame costs and startup timings. */
+static float elapsed_ms(std::chrono::steady_clock::time_point start)
 {
-    wf::option_wrapper_t<int> opt_icon_size{"shader-dock/icon_size"};
-    wf::option_wrapper_t<int> opt_spacing{"shader-dock/spacing"};
-    wf::option_wrapper_t<int> opt_margin{"shader-dock/margin"};
-    wf::option_wrapper_t<double> opt_corner_radius{"shader-dock/corner_radius"};
-    wf::option_wrapper_t<wf::color_t> opt_bevel_color{"shader-dock/bevel_color"};
-    wf::option_wrapper_t<wf::color_t> opt_background_color{"shader-dock/background_color"};
-    wf::option_wrapper_t<std::string> opt_apps{"shader-dock/apps"};
-
-    std::vector<DockIcon> icons;
-    ShaderProgram icon_shader, bg_shader;
-    GLuint vao = 0, vbo = 0, ebo = 0;
-    bool gl_initialized = false;
+    return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
 
-    wf::geometry_t dock_geometry{0, 0, 0, 0};
-    int icon_size = 64, spacing = 8, margin = 8;
-    float corner_radius = 12.0f;
-    glm::vec4 bevel_color{0.8f, 0.7f, 0.5f, 0.6f};
-    glm::vec4 bg_color{0.1f, 0.1f, 0.1f, 0.85f};
+/**
+ * Icon theme lookup, built once per process and shared by all outputs.
+ *
+ * Each theme's index.theme supplies its directories and Inherits= chain.
+ * Where a theme directory has an up to date icon-theme.cache, the cache is
+ * mapped and probed in place; otherwise the application directories are
+ * listed once. Lookups never touch the filesystem.
+ */
+class IconThemeIndex : public wf::custom_data_t
+{
+  public:
+    IconThemeIndex()
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::string home = getenv("HOME") ? getenv("HOME") : "";
+        const char *data_home = getenv("XDG_DATA_HOME");
+        const char *data_dirs = getenv("XDG_DATA_DIRS");
+
+        base_dirs.push_back(home + "/.icons");
+        base_dirs.push_back((data_home && *data_home) ?
+                            std::string(data_home) + "/icons" : home + "/.local/share/icons");
+        std::stringstream dirs((data_dirs && *data_dirs) ? data_dirs : "/usr/local/share:/usr/share");
+        for (std::string dir; std::getline(dirs, dir, ':');)
+            if (!dir.empty()) base_dirs.push_back(dir + "/icons");
+
+        for (const char *name : {"hicolor", "Adwaita", "breeze", "Papirus"})
+            add_theme(name);
+
+        list_pngs("/usr/share/pixmaps", [&] (std::string name) { pixmaps.insert(std::move(name)); });
+        LOGI("shader-dock: indexed ", themes.size(), " icon themes in ", elapsed_ms(start), " ms");
+    }
 
-    std::chrono::steady_clock::time_point start_time;
-    int hovered_icon = -1;
-    wf::wl_timer<false> animation_timer;
+    /**
+     * Find a PNG for @icon_name, preferring the smallest size that is at
+     * least @size pixels so that scaling it down loses as little as possible.
+     */
+    std::string lookup(const std::string& icon_name, int size) const
+    {
+        if (icon_name.find('/') != std::string::npos)
+            return std::filesystem::exists(icon_name) ? icon_name : "";
+
+        for (const auto& theme : themes) {
+            const Location *best_location = nullptr;
+            const Subdir *best = nullptr;
+            for (const auto& location : theme.locations)
+                location.find(icon_name, [&] (int subdir) {
+                    const Subdir& dir = theme.subdirs[subdir];
+                    if (!best || prefer(dir.size, best->size, size)) {
+                        best = &dir;
+                        best_location = &location;
+                    }
+                });
+            if (best) return best_location->path + "/" + best->name + "/" + icon_name + ".png";
+        }
 
-    wf::signal::connection_t<wf::output_configuration_changed_signal> on_output_changed =
-        [=] (wf::output_configuration_changed_signal*) {
-            update_geometry();
-            output->render->damage_whole();
-        };
+        if (pixmaps.count(icon_name)) return "/usr/share/pixmaps/" + icon_name + ".png";
+        return "";
+    }
 
-    // Pointer button signal connection
-    wf::signal::connection_t<wf::post_input_event_signal<wlr_pointer_button_event>> on_button =
-        [=] (wf::post_input_event_signal<wlr_pointer_button_event> *ev) {
-            handle_button(ev->event);
-        };
+  private:
+    // icon-theme.cache image flag, see gtk/gtkiconcache.c
+    static constexpr uint16_t cache_has_suffix_png = 1 << 2;
 
-  public:
-    void init() override
+    struct Subdir
     {
-        start_time = std::chrono::steady_clock::now();
-        
-        // Get config values with sensible defaults
-        icon_size = opt_icon_size;
-        spacing = opt_spacing;
-        margin = opt_margin;
-        corner_radius = opt_corner_radius;
-        
-        // Ensure sensible minimums
-        if (icon_size <= 0) icon_size = 64;
-        if (spacing < 0) spacing = 8;
-        if (margin < 0) margin = 8;
-        if (corner_radius < 0) corner_radius = 12.0f;
-        
-        LOGD("shader-dock: icon_size=", icon_size, " spacing=", spacing, " margin=", margin);
+        std::string name;
+        int size;  // Size= times Scale=
+    };
 
-        wf::color_t bc = opt_bevel_color;
-        bevel_color = glm::vec4(bc.r, bc.g, bc.b, bc.a);
-        wf::color_t bgc = opt_background_color;
-        bg_color = glm::vec4(bgc.r, bgc.g, bgc.b, bgc.a);
+    /** One installed copy of a theme, under one of the base directories. */
+    struct Location
+    {
+        std::string path;
+        std::shared_ptr<MappedFile> cache;
+        std::vector<int> cache_subdirs;  // cache directory index -> subdir, or -1
+        std::unordered_map<std::string, std::vector<int>> listed;  // used without a cache
+
+        template<class F>
+        void find(const std::string& icon_name, F&& on_match) const
+        {
+            if (!cache) {
+                auto it = listed.find(icon_name);
+                if (it != listed.end())
+                    for (int subdir : it->second) on_match(subdir);
+                return;
+            }
 
-        std::string apps_str = opt_apps;
-        LOGD("shader-dock: apps = '", apps_str, "'");
-        
-        std::istringstream iss(apps_str);
-        std::string app;
-        while (iss >> app) {
-            DockIcon icon;
-            if (parse_desktop_file(app, icon)) {
-                std::string path = find_icon_path(icon.icon_path, icon_size);
-                if (!path.empty()) {
-                    icon.icon_path = path;
-                    icons.push_back(std::move(icon));
-                    LOGD("shader-dock: added ", app);
+            const MappedFile& f = *cache;
+            size_t hash = cache_u32(f, 4);
+            uint32_t n_buckets = cache_u32(f, hash);
+            if (n_buckets == 0 || n_buckets == UINT32_MAX) return;
+
+            uint32_t icon = cache_u32(f, hash + 4 + 4 * (size_t)(cache_hash(icon_name) % n_buckets));
+            for (int guard = 0; icon != UINT32_MAX && guard < 4096; guard++, icon = cache_u32(f, icon)) {
+                const char *name = cache_str(f, cache_u32(f, (size_t)icon + 4));
+                if (!name || icon_name != name) continue;
+
+                size_t images = cache_u32(f, (size_t)icon + 8);
+                size_t n_images = std::min<size_t>(cache_u32(f, images), f.length / 8);
+                for (size_t i = 0; i < n_images; i++) {
+                    uint16_t dir = cache_u16(f, images + 4 + 8 * i);
+                    uint16_t flags = cache_u16(f, images + 6 + 8 * i);
+                    if ((flags & cache_has_suffix_png) && dir < cache_subdirs.size() && cache_subdirs[dir] >= 0)
+                        on_match(cache_subdirs[dir]);
                 }
+                return;
             }
         }
+    };
 
-        update_geometry();
+    struct Theme
+    {
+        std::string name;
+        std::vector<Subdir> subdirs;
+        std::vector<Location> locations;
+    };
 
-        output->render->add_effect(&damage_hook, wf::OUTPUT_EFFECT_DAMAGE);
-        output->render->add_effect(&overlay_hook, wf::OUTPUT_EFFECT_OVERLAY);
-        output->connect(&on_output_changed);
-        
-        // Connect to pointer button events
-        wf::get_core().connect(&on_button);
+    using IniSections = std::unordered_map<std::string, std::unordered_map<std::string, std::string>>;
 
-        animation_timer.set_timeout(16, [this] () {
-            output->render->damage(dock_geometry);
-            return true;
-        });
+    std::vector<std::string> base_dirs;
+    std::vector<Theme> themes;  // in lookup order, each before the themes it inherits
+    std::unordered_set<std::string> pixmaps;
 
-        output->render->damage_whole();
-        LOGD("shader-dock: initialized with ", icons.size(), " icons");
+    /** Whether an icon of @a pixels beats one of @b pixels for a @size pixel slot. */
+    static bool prefer(int a, int b, int size)
+    {
+        if ((a >= size) != (b >= size)) return a >= size;
+        return a >= size ? a < b : a > b;
     }
 
-    void handle_button(wlr_pointer_button_event *event)
+    void add_theme(const std::string& name)
     {
-        auto cursor = wf::get_core().get_cursor_position();
-        
-        LOGD("shader-dock: button event - button=", event->button, 
-             " state=", event->state, " cursor=(", cursor.x, ",", cursor.y, ")");
-        
-        // Only handle left click release
-        if (event->button != BTN_LEFT || event->state != WLR_BUTTON_RELEASED) {
-            return;
+        for (const auto& theme : themes)
+            if (theme.name == name) return;
+
+        IniSections index;
+        bool found = false;
+        for (const auto& base : base_dirs)
+            if ((found = parse_index(base + "/" + name + "/index.theme", index))) break;
+        if (!found) return;
+
+        Theme theme;
+        theme.name = name;
+        auto& info = index["Icon Theme"];
+        auto dirs = split_list(info["Directories"]);
+        for (auto& dir : split_list(info["ScaledDirectories"])) dirs.push_back(dir);
+        for (const auto& dir : dirs) {
+            auto& section = index[dir];
+            if (section["Context"] != "Applications") continue;
+            int scale = std::max(1, std::atoi(section["Scale"].c_str()));
+            theme.subdirs.push_back({dir, std::atoi(section["Size"].c_str()) * scale});
         }
-        
-        int clicked = get_icon_at(cursor.x, cursor.y);
-        LOGD("shader-dock: left click release, icon index=", clicked);
-        
-        if (clicked >= 0 && clicked < (int)icons.size()) {
-            LOGD("shader-dock: launching '", icons[clicked].exec, "'");
-            launch_application(icons[clicked].exec);
+
+        for (const auto& base : base_dirs) {
+            Location location;
+            location.path = base + "/" + name;
+            struct stat dir_st, cache_st;
+            if (stat(location.path.c_str(), &dir_st) != 0) continue;
+
+            // Same staleness rule as GTK: the cache must not predate the directory
+            std::string cache_path = location.path + "/icon-theme.cache";
+            if (stat(cache_path.c_str(), &cache_st) != 0 || cache_st.st_mtime < dir_st.st_mtime ||
+                !load_cache(theme, cache_path, location)) {
+                for (size_t i = 0; i < theme.subdirs.size(); i++)
+                    list_pngs(location.path + "/" + theme.subdirs[i].name,
+                              [&] (std::string icon) { location.listed[std::move(icon)].push_back(i); });
+            }
+            theme.locations.push_back(std::move(location));
         }
+
+        themes.push_back(std::move(theme));
+        for (const auto& parent : split_list(info["Inherits"]))
+            add_theme(parent);
     }
 
-    void update_geometry()
+    static bool load_cache(const Theme& theme, const std::string& path, Location& location)
     {
-        auto og = output->get_layout_geometry();
-        int n = icons.empty() ? 1 : (int)icons.size();
-        // Vertical layout on left edge
-        int w = icon_size + margin * 2;
-        int h = n * icon_size + (n > 1 ? (n - 1) * spacing : 0) + margin * 2;
-        dock_geometry.x = og.x + margin;
-        dock_geometry.y = og.y + (og.height - h) / 2;  // Centered vertically
-        dock_geometry.width = w;
-        dock_geometry.height = h;
-        
-        LOGD("shader-dock: geometry x=", dock_geometry.x, " y=", dock_geometry.y, 
-             " w=", dock_geometry.width, " h=", dock_geometry.height,
-             " icons=", n, " icon_size=", icon_size, " spacing=", spacing);
-    }
+        auto file = map_file(path, false);
+        if (!file || cache_u16(*file, 0) != 1) return false;
 
-    float get_time() const {
-        return std::chrono::duration<float>(std::chrono::steady_clock::now() - start_time).count();
-    }
+        size_t dir_list = cache_u32(*file, 8);
+        uint32_t n_dirs = cache_u32(*file, dir_list);
+        if (n_dirs > file->length / 4) return false;
 
-    int get_icon_at(int x, int y) const {
-        if (x < dock_geometry.x || x >= dock_geometry.x + dock_geometry.width ||
-            y < dock_geometry.y || y >= dock_geometry.y + dock_geometry.height)
-            return -1;
-        int ly = y - dock_geometry.y - margin;
-        if (ly < 0) return -1;
-        int idx = ly / (icon_size + spacing);
-        int off = ly % (icon_size + spacing);
-        if (idx >= 0 && idx < (int)icons.size() && off < icon_size) {
-            // Reverse index to match visual order (icons render bottom-to-top in array)
-            return (int)icons.size() - 1 - idx;
+        for (uint32_t i = 0; i < n_dirs; i++) {
+            const char *dir = cache_str(*file, cache_u32(*file, dir_list + 4 + 4 * (size_t)i));
+            if (!dir) return false;
+
+            int subdir = -1;
+            for (size_t j = 0; j < theme.subdirs.size(); j++)
+                if (theme.subdirs[j].name == dir) subdir = j;
+            location.cache_subdirs.push_back(subdir);
         }
-        return -1;
+
+        location.cache = std::move(file);
+        return true;
     }
 
-    void init_gl()
+    // icon-theme.cache is big endian; reads past the end give UINT*_MAX
+    static uint16_t cache_u16(const MappedFile& f, size_t offset)
     {
-        if (gl_initialized) return;
-
-        // Save GL state
-        GLint prev_vao, prev_vbo, prev_texture;
-        glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &prev_vao);
-        glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &prev_vbo);
-        glGetIntegerv(GL_TEXTURE_BINDING_2D, &prev_texture);
-
-        if (!icon_shader.compile(vertex_shader_src, icon_fragment_shader_src)) {
-            LOGD("shader-dock: icon shader failed");
-            return;
-        }
-        if (!bg_shader.compile(vertex_shader_src, background_fragment_shader_src)) {
-            LOGD("shader-dock: bg shader failed");
-            return;
-        }
+        if (offset + 2 > f.length) return UINT16_MAX;
+        return f.bytes()[offset] << 8 | f.bytes()[offset + 1];
+    }
 
-        float verts[] = {
-            // pos x, pos y, tex u, tex v (flipped V)
-            0, 0, 0, 1,
-            1, 0, 1, 1,
-            1, 1, 1, 0,
-            0, 1, 0, 0
-        };
-        unsigned int inds[] = {0, 1, 2, 2, 3, 0};
+    static uint32_t cache_u32(const MappedFile& f, size_t offset)
+    {
+        if (offset + 4 > f.length) return UINT32_MAX;
+        return (uint32_t)cache_u16(f, offset) << 16 | cache_u16(f, offset + 2);
+    }
 
-        glGenVertexArrays(1, &vao);
-        glGenBuffers(1, &vbo);
-        glGenBuffers(1, &ebo);
+    static const char *cache_str(const MappedFile& f, size_t offset)
+    {
+        if (offset >= f.length) return nullptr;
+        auto str = (const char*)f.bytes() + offset;
+        return std::memchr(str, 0, f.length - offset) ? str : nullptr;
+    }
 
-        glBindVertexArray(vao);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(inds), inds, GL_STATIC_DRAW);
+    static uint32_t cache_hash(const std::string& name)
+    {
+        // GTK's icon_name_hash(), over signed chars
+        uint32_t h = 0;
+        for (signed char c : name) h = (h << 5) - h + c;
+        return h;
+    }
 
-        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 16, (void*)0);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 16, (void*)8);
-        glEnableVertexAttribArray(1);
+    template<class F>
+    static void list_pngs(const std::string& dir, F&& on_icon)
+    {
+        std::error_code ec;
+        for (std::filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec))
+            if (it->path().extension() == ".png") on_icon(it->path().stem().string());
+    }
 
-        for (auto& icon : icons) {
-            if (!icon.texture_loaded && !icon.icon_path.empty()) {
-                if (load_png_texture(icon.icon_path, icon.texture_id, icon.width, icon.height)) {
-                    icon.texture_loaded = true;
-                    LOGD("shader-dock: loaded ", icon.app_id);
-                }
+    static bool parse_index(const std::string& path, IniSections& out)
+    {
+        std::ifstream file(path);
+        if (!file.is_open()) return false;
+
+        std::string line;
+        std::unordered_map<std::string, std::string> *section = nullptr;
+        while (std::getline(file, line)) {
+            size_t start = line.find_first_not_of(" \t");
+            if (start == std::string::npos || line[start] == '#') continue;
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            if (line[start] == '[') {
+                section = &out[line.substr(start + 1, line.size() - start - 2)];
+                continue;
             }
-        }
-
-        // Restore GL state
-        glBindVertexArray(prev_vao);
-        glBindBuffer(GL_ARRAY_BUFFER, prev_vbo);
-        glBindTexture(GL_TEXTURE_2D, prev_texture);
 
-        gl_initialized = true;
+            size_t eq = line.find('=');
+            if (!section || eq == std::string::npos) continue;
+            std::string key = line.substr(start, eq - start);
+            key.erase(key.find_last_not_of(" \t") + 1);
+            size_t vs = line.find_first_not_of(" \t", eq + 1);
+            (*section)[key] = vs == std::string::npos ? "" : line.substr(vs);
+        }
+        return true;
     }
 
-    void render_dock(const wf::render_target_t& fb)
+    static std::vector<std::string> split_list(const std::string& value)
     {
-        if (icons.empty()) return;
-
-        auto cursor = wf::get_core().get_cursor_position();
-        hovered_icon = get_icon_at(cursor.x, cursor.y);
-
-        float time = get_time();
-
-        // Save GL state to prevent black screen flashes
-        GLint prev_program;
-        glGetIntegerv(GL_CURRENT_PROGRAM, &prev_program);
-        GLint prev_vao;
-        glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &prev_vao);
-        GLint prev_texture;
-        glGetIntegerv(GL_TEXTURE_BINDING_2D, &prev_texture);
-        GLint prev_active_texture;
-        glGetIntegerv(GL_ACTIVE_TEXTURE, &prev_active_texture);
-        GLboolean prev_blend = glIsEnabled(GL_BLEND);
-        GLint prev_blend_src_rgb, prev_blend_dst_rgb, prev_blend_src_a, prev_blend_dst_a;
-        glGetIntegerv(GL_BLEND_SRC_RGB, &prev_blend_src_rgb);
-        glGetIntegerv(GL_BLEND_DST_RGB, &prev_blend_dst_rgb);
-        glGetIntegerv(GL_BLEND_SRC_ALPHA, &prev_blend_src_a);
-        glGetIntegerv(GL_BLEND_DST_ALPHA, &prev_blend_dst_a);
-
-        // Use wayfire's projection (Y down, top-left origin)
-        glm::mat4 proj = glm::ortho(
-            (float)fb.geometry.x,
-            (float)(fb.geometry.x + fb.geometry.width),
-            (float)(fb.geometry.y + fb.geometry.height),
-            (float)fb.geometry.y,
-            -1.0f, 1.0f
-        );
-
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        std::vector<std::string> items;
+        std::stringstream stream(value);
+        for (std::string item; std::getline(stream, item, ',');) {
+            item.erase(0, item.find_first_not_of(" \t"));
+            item.erase(item.find_last_not_of(" \t") + 1);
+            if (!item.empty()) items.push_back(item);
+        }
+        return items;
+    }
+};
 
-        // Background
-        glUseProgram(bg_shader.program);
-        glm::mat4 model = glm::translate(glm::mat4(1), glm::vec3(dock_geometry.x, dock_geometry.y, 0));
-        model = glm::scale(model, glm::vec3(dock_geometry.width, dock_geometry.height, 1));
-        glm::mat4 mvp = proj * model;
+/**
+ * A small pool of worker threads decoding icon PNGs off the compositor
+ * thread. Finished results are handed back on the main loop, woken up
+ * through an eventfd.
+ */
+class IconDecoder
+{
+  public:
+    struct Result
+    {
+        std::string path;
+        int size = 0;
+        std::vector<uint8_t> pixels;         // freshly decoded, or
+        std::shared_ptr<MappedFile> mapped;  // mapped from the icon cache
+        const uint8_t *mapped_pixels = nullptr;
+        int width = 0;
+        int height = 0;
+        bool ok = false;
+
+        const uint8_t *data() const { return mapped ? mapped_pixels : pixels.data(); }
+        size_t byte_size() const { return (size_t)width * height * 4; }
+    };
+    using callback_t = std::function<void(Result&&)>;
 
-        glUniformMatrix4fv(bg_shader.u_mvp, 1, GL_FALSE, glm::value_ptr(mvp));
-        glUniform2f(bg_shader.u_resolution, dock_geometry.width, dock_geometry.height);
-        glUniform1f(bg_shader.u_corner_radius, corner_radius + 4);
-        glUniform4fv(bg_shader.u_background_color, 1, glm::value_ptr(bg_color));
-        glUniform1f(bg_shader.u_time, time);
+    IconDecoder(callback_t on_result) : on_result(std::move(on_result)) {}
 
-        glBindVertexArray(vao);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    ~IconDecoder()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        cv.notify_all();
+        for (auto& t : workers) t.join();
 
-        // Icons - vertical layout
-        glUseProgram(icon_shader.program);
-        float icon_x = (float)(dock_geometry.x + margin);
-        float icon_y = (float)(dock_geometry.y + margin);
-        float icon_step = (float)(icon_size + spacing);
+        if (event_source) wl_event_source_remove(event_source);
+        if (event_fd >= 0) close(event_fd);
+    }
 
-        for (size_t i = 0; i < icons.size(); i++) {
-            auto& icon = icons[i];
-            if (!icon.texture_loaded) { 
-                icon_y += icon_step; 
-                continue; 
-            }
+    /** Decode @path and scale it to @size pixels, see scale_icon_image(). */
+    void queue(const std::string& path, int size)
+    {
+        if (workers.empty() && !start()) {
+            // No threads available, decode right here instead
+            on_result(run_job({path, size}));
+            return;
+        }
 
-            float target = (hovered_icon == (int)i) ? 1.0f : 0.0f;
-            icon.hover += (target - icon.hover) * 0.2f;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back({path, size});
+        }
+        cv.notify_one();
+    }
 
-            model = glm::translate(glm::mat4(1.0f), glm::vec3(icon_x, icon_y, 0.0f));
-            model = glm::scale(model, glm::vec3((float)icon_size, (float)icon_size, 1.0f));
-            mvp = proj * model;
+  private:
+    callback_t on_result;
+    std::mutex mutex;
+    std::condition_variable cv;
+    struct Job
+    {
+        std::string path;
+        int size;
+    };
+    std::deque<Job> jobs;
+    std::vector<Result> results;
+    bool quit = false;
+    std::vector<std::thread> workers;
+    int event_fd = -1;
+    wl_event_source *event_source = nullptr;
+
+    bool start()
+    {
+        event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (event_fd < 0) return false;
+        event_source = wl_event_loop_add_fd(wf::get_core().ev_loop, event_fd,
+                                            WL_EVENT_READABLE, handle_event, this);
+
+        unsigned count = std::clamp(std::thread::hardware_concurrency(), 1u, 4u);
+        for (unsigned i = 0; i < count; i++)
+            workers.emplace_back([this] () { worker_main(); });
+        return true;
+    }
 
-            glUniformMatrix4fv(icon_shader.u_mvp, 1, GL_FALSE, glm::value_ptr(mvp));
-            glUniform1i(icon_shader.u_texture, 0);
-            glUniform2f(icon_shader.u_resolution, (float)icon_size, (float)icon_size);
-            glUniform1f(icon_shader.u_corner_radius, corner_radius);
-            glUniform4fv(icon_shader.u_bevel_color, 1, glm::value_ptr(bevel_color));
-            glUniform1f(icon_shader.u_time, time);
-            glUniform1f(icon_shader.u_hover, icon.hover);
+    void worker_main()
+    {
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this] () { return quit || !jobs.empty(); });
+                if (quit) return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
 
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, icon.texture_id);
-            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+            Result res = run_job(job);
 
-            icon_y += icon_step;  // Move down for vertical layout
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                results.push_back(std::move(res));
+            }
+            uint64_t one = 1;
+            if (write(event_fd, &one, sizeof(one)) < 0) {
+                // Counter overflow only, the main loop is woken up anyway
+            }
         }
-
-        // Restore GL state
-        glBindVertexArray(prev_vao);
-        glActiveTexture(prev_active_texture);
-        glBindTexture(GL_TEXTURE_2D, prev_texture);
-        glUseProgram(prev_program);
-        
-        if (prev_blend)
-            glEnable(GL_BLEND);
-        else
-            glDisable(GL_BLEND);
-        glBlendFuncSeparate(prev_blend_src_rgb, prev_blend_dst_rgb, prev_blend_src_a, prev_blend_dst_a);
     }
 
-    wf::effect_hook_t damage_hook = [=] () {
-        output->render->damage(dock_geometry, false);
-    };
-
-    wf::effect_hook_t overlay_hook = [=] () {
-        if (icons.empty()) return;
+    static Result run_job(const Job& job)
+    {
+        Result res;
+        res.path = job.path;
+        res.size = job.size;
+
+        int64_t mtime_ns;
+        if (!source_mtime(job.path, mtime_ns)) return res;
+        if (load_cached_icon(job.path, mtime_ns, job.size, res.mapped, res.mapped_pixels,
+                             res.width, res.height)) {
+            res.ok = true;
+            return res;
+        }
 
-        if (!gl_initialized) {
-            init_gl();
-            if (!gl_initialized) return;
+        // Another size was decoded before: scale that copy of the source
+        std::shared_ptr<MappedFile> mapped;
+        const uint8_t *source;
+        std::vector<uint8_t> decoded;
+        int sw, sh;
+        if (load_cached_icon(job.path, mtime_ns, 0, mapped, source, sw, sh)) {
+            res.ok = true;
+        } else {
+            if (!decode_png(job.path, decoded, sw, sh)) return res;
+            res.ok = true;
+            source = decoded.data();
+            store_cached_icon(job.path, mtime_ns, 0, decoded, sw, sh);
         }
 
-        auto fb = output->render->get_target_framebuffer();
-        render_dock(fb);
-    };
+        if (scale_icon_image(source, sw, sh, job.size, res.pixels, res.width, res.height)) {
+            store_cached_icon(job.path, mtime_ns, job.size, res.pixels, res.width, res.height);
+        } else if (mapped) {
+            res.mapped = std::move(mapped);
+            res.mapped_pixels = source;
+            res.width = sw;
+            res.height = sh;
+        } else {
+            res.pixels = std::move(decoded);
+            res.width = sw;
+            res.height = sh;
+        }
+        return res;
+    }
 
-    void fini() override
+    static int handle_event(int fd, uint32_t, void *data)
     {
-        animation_timer.disconnect();
-        output->render->rem_effect(&damage_hook);
-        output->render->rem_effect(&overlay_hook);
-        on_button.disconnect();
+        auto self = (IconDecoder*)data;
+        uint64_t count;
+        if (read(fd, &count, sizeof(count)) < 0) return 0;
+
+        std::vector<Result> done;
+        {
+            std::lock_guard<std::mutex> lock(self->mutex);
+            done.swap(self->results);
+        }
+        for (auto& res : done)
+            self->on_result(std::move(res));
+        return 0;
+    }
+};
 
-        for (auto& icon : icons)
-            if (icon.texture_id) glDeleteTextures(1, &icon.texture_id);
+// Emitted on SharedIconAtlas when a decoded icon waits for its upload
+struct icon_decoded_signal
+{
+    std::string path;
+};
+
+/**
+ * GL objects belong to the context that made them. Resources of type T are
+ * kept once per wlr_renderer that draws the frames, and shared by the docks
+ * of its outputs. Wayfire 0.9 draws every output with its single renderer,
+ * in the context OpenGL::render_begin() makes current, so there is one copy.
+ */
+template<class T>
+class PerRenderer : public wf::custom_data_t
+{
+  public:
+    /** The copy of @renderer, made on first use. */
+    T& acquire(wlr_renderer *renderer)
+    {
+        auto& copy = copies[renderer];
+        if (!copy.resources) copy.resources = std::make_unique<T>();
+        copy.users++;
+        return *copy.resources;
+    }
+
+    /** Drop a use of @renderer's copy. The last one frees it, with the GL context current. */
+    void release(wlr_renderer *renderer)
+    {
+        auto it = copies.find(renderer);
+        if (it != copies.end() && --it->second.users == 0) copies.erase(it);
+    }
+
+  private:
+    struct Copy
+    {
+        std::unique_ptr<T> resources;
+        int users = 0;
+    };
+    std::unordered_map<wlr_renderer*, Copy> copies;
+};
+
+/**
+ * The icon atlas shared by the dock instances of the outputs of one
+ * renderer, see PerRenderer. Every icon image is decoded and scaled once
+ * per pixel size, in the background, and then reference counted by path
+ * and size; the texture itself is freed when the last icon is released.
+ *
+ * Decoded images only reach the texture in flush_uploads(), which the
+ * docks call from their render path where the GL context is current.
+ */
+class SharedIconAtlas : public wf::signal::provider_t
+{
+  public:
+    IconAtlas atlas;
+
+    /**
+     * Take a reference to the icon at @path scaled to @size pixels, queueing
+     * its decode on first use.
+     */
+    IconState acquire(const std::string& path, int size, AtlasRect& rect)
+    {
+        if (auto entry = find(path, size)) {
+            entry->refs++;
+            rect = entry->rect;
+            return entry->state;
+        }
+
+        entries[path].push_back({size, AtlasRect{}, IconState::Loading, 1});
+        if (decoding++ == 0) {
+            batch_start = std::chrono::steady_clock::now();
+            batch_size = 0;
+        }
+        batch_size++;
+        decoder.queue(path, size);
+        return IconState::Loading;
+    }
+
+    /** Current state of an acquired icon, and its rect once it is Ready. */
+    IconState lookup(const std::string& path, int size, AtlasRect& rect) const
+    {
+        auto entry = find(path, size);
+        if (!entry) return IconState::Unloaded;
+        rect = entry->rect;
+        return entry->state;
+    }
+
+    void release(const std::string& path, int size)
+    {
+        auto it = entries.find(path);
+        if (it == entries.end()) return;
+        auto& sizes = it->second;
+        auto entry = std::find_if(sizes.begin(), sizes.end(), [=] (const Entry& e) { return e.size == size; });
+        if (entry == sizes.end() || --entry->refs > 0) return;
+
+        if (entry->state == IconState::Ready)
+            atlas.free(entry->rect);
+        sizes.erase(entry);
+        if (sizes.empty()) entries.erase(it);
+        if (entries.empty())
+            destroy();
+    }
+
+    /**
+     * Move decoded images into the atlas, staged through a pixel unpack
+     * buffer. Changes the GL_TEXTURE_2D binding of the active texture unit.
+     */
+    void flush_uploads()
+    {
+        if (uploads.empty()) return;
+
+        auto start = std::chrono::steady_clock::now();
+        size_t count = uploads.size();
+        for (auto& res : uploads) {
+            auto found = find(res.path, res.size);
+            // Released in the meantime, or released and acquired again with
+            // a second decode queued, whose entry the first one already filled
+            if (!found || found->state != IconState::Loading) continue;
+
+            auto& entry = *found;
+            if (!atlas.allocate(res.width, res.height, entry.rect)) {
+                entry.state = IconState::Failed;
+                continue;
+            }
+
+            if (!pbo) glGenBuffers(1, &pbo);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, res.byte_size(), nullptr, GL_STREAM_DRAW);
+            void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, res.byte_size(),
+                                         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            if (dst) {
+                std::memcpy(dst, res.data(), res.byte_size());
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                atlas.upload(nullptr, entry.rect);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            } else {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                atlas.upload(res.data(), entry.rect);
+            }
+            entry.state = IconState::Ready;
+        }
+        atlas.update_mipmaps();
+        uploads.clear();
+        LOGD("shader-dock: uploaded ", count, " icons in ", elapsed_ms(start), " ms");
+    }
+
+    ~SharedIconAtlas()
+    {
+        destroy();
+    }
+
+  private:
+    struct Entry
+    {
+        int size;
+        AtlasRect rect;
+        IconState state = IconState::Loading;
+        int refs = 0;
+    };
+    // By path, then one entry per pixel size: looking one up builds no key
+    std::unordered_map<std::string, std::vector<Entry>> entries;
+    std::vector<IconDecoder::Result> uploads;
+    GLuint pbo = 0;
+
+    // Decodes queued since the decoder was last idle, timed as one batch
+    int decoding = 0;
+    size_t batch_size = 0;
+    int batches = 0;
+    std::chrono::steady_clock::time_point batch_start;
+
+    const Entry* find(const std::string& path, int size) const
+    {
+        auto it = entries.find(path);
+        if (it == entries.end()) return nullptr;
+        for (const auto& entry : it->second)
+            if (entry.size == size) return &entry;
+        return nullptr;
+    }
+
+    Entry* find(const std::string& path, int size)
+    {
+        return const_cast<Entry*>(std::as_const(*this).find(path, size));
+    }
+
+    IconDecoder decoder{[this] (IconDecoder::Result&& res) {
+        if (--decoding == 0) {
+            // The first batch is the startup's, later ones follow scrolling and new scales
+            if (batches++ == 0) {
+                LOGI("shader-dock: decoded ", batch_size, " icons in ", elapsed_ms(batch_start), " ms");
+            } else {
+                LOGD("shader-dock: decoded ", batch_size, " icons in ", elapsed_ms(batch_start), " ms");
+            }
+        }
+
+        auto entry = find(res.path, res.size);
+        if (!entry) return;
+
+        if (!res.ok) {
+            LOGD("shader-dock: failed to decode ", res.path);
+            entry->state = IconState::Failed;
+        }
+
+        icon_decoded_signal ev;
+        ev.path = res.path;
+        if (res.ok) uploads.push_back(std::move(res));
+        emit(&ev);
+    }};
+
+    void destroy()
+    {
+        atlas.destroy();
+        if (pbo) glDeleteBuffers(1, &pbo);
+        pbo = 0;
+    }
+};
+
+// Emitted on PowerMonitor when the system goes on or off battery
+struct power_source_changed_signal
+{};
+
+/**
+ * Whether the system runs on battery, for the automatic render quality.
+ * The power supplies are polled from sysfs while any dock watches.
+ */
+class PowerMonitor : public wf::custom_data_t, public wf::signal::provider_t
+{
+  public:
+    bool on_battery = false;
+
+    void watch()
+    {
+        if (watchers++ > 0) return;
+        poll();
+        poll_timer.set_timeout(poll_interval_ms, [=] () {
+            poll();
+            return true;
+        });
+    }
+
+    void unwatch()
+    {
+        if (--watchers == 0) poll_timer.disconnect();
+    }
+
+  private:
+    static constexpr uint32_t poll_interval_ms = 10000;
+    int watchers = 0;
+    wf::wl_timer<true> poll_timer;
+
+    static std::string read_attribute(const std::filesystem::path& path)
+    {
+        std::ifstream file(path);
+        std::string value;
+        std::getline(file, value);
+        return value;
+    }
+
+    void poll()
+    {
+        bool discharging = false;
+        std::error_code ec;
+        for (std::filesystem::directory_iterator it("/sys/class/power_supply", ec), end;
+             !ec && it != end; it.increment(ec)) {
+            if (read_attribute(it->path() / "type") == "Battery" &&
+                read_attribute(it->path() / "status") == "Discharging")
+                discharging = true;
+        }
+
+        if (discharging == on_battery) return;
+        on_battery = discharging;
+        LOGD("shader-dock: ", on_battery ? "on" : "off", " battery");
+        power_source_changed_signal ev;
+        emit(&ev);
+    }
+};
+
+// Emitted on DesktopDatabase when the entry of an app id changed on disk
+struct desktop_entry_changed_signal
+{
+    std::string app_id;
+};
+
+/**
+ * The installed desktop entries, shared by all outputs. Entries are found
+ * through $XDG_DATA_HOME and $XDG_DATA_DIRS, earlier directories winning,
+ * parsed once when first asked for, and re-read when inotify reports that
+ * their file changed in one of the applications directories.
+ */
+class DesktopDatabase : public wf::custom_data_t, public wf::signal::provider_t
+{
+  public:
+    DesktopDatabase()
+    {
+        const char *data_home = getenv("XDG_DATA_HOME");
+        const char *home = getenv("HOME");
+        if (data_home && *data_home) dirs.push_back(std::string(data_home) + "/applications");
+        else if (home) dirs.push_back(std::string(home) + "/.local/share/applications");
+
+        const char *data_dirs = getenv("XDG_DATA_DIRS");
+        std::istringstream stream(data_dirs && *data_dirs ? data_dirs : "/usr/local/share:/usr/share");
+        for (std::string dir; std::getline(stream, dir, ':');)
+            if (!dir.empty()) dirs.push_back(dir + "/applications");
+
+        // Directories created later are not noticed
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd < 0) return;
+        for (const auto& dir : dirs)
+            inotify_add_watch(inotify_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE);
+        source = wl_event_loop_add_fd(wf::get_core().ev_loop, inotify_fd, WL_EVENT_READABLE, handle_inotify, this);
+    }
+
+    ~DesktopDatabase()
+    {
+        if (source) wl_event_source_remove(source);
+        if (inotify_fd >= 0) close(inotify_fd);
+    }
+
+    /** The entry of @app_id, or nullptr if none is installed. */
+    const DesktopEntry* find(const std::string& app_id)
+    {
+        auto it = entries.find(app_id);
+        if (it == entries.end()) it = entries.emplace(app_id, load(app_id)).first;
+        return it->second ? &*it->second : nullptr;
+    }
+
+  private:
+    std::vector<std::string> dirs;
+    // Every app id asked for so far, including those without an entry
+    std::unordered_map<std::string, std::optional<DesktopEntry>> entries;
+    int inotify_fd = -1;
+    wl_event_source *source = nullptr;
+
+    std::optional<DesktopEntry> load(const std::string& app_id)
+    {
+        for (const auto& dir : dirs) {
+            DesktopEntry entry;
+            if (!parse_desktop_entry(dir + "/" + app_id + ".desktop", entry)) continue;
+            // The first file found decides, a hidden one deletes the app
+            if (entry.hidden || entry.exec.empty()) return std::nullopt;
+            return entry;
+        }
+        return std::nullopt;
+    }
+
+    static int handle_inotify(int fd, uint32_t, void *data)
+    {
+        auto self = (DesktopDatabase*)data;
+        alignas(inotify_event) char buf[4096];
+        std::unordered_set<std::string> changed;
+        ssize_t len;
+        while ((len = read(fd, buf, sizeof(buf))) > 0) {
+            for (char *p = buf; p < buf + len;) {
+                auto ev = (const inotify_event*)p;
+                p += sizeof(inotify_event) + ev->len;
+                std::string_view name = ev->len ? ev->name : "";
+                constexpr std::string_view suffix = ".desktop";
+                if (name.size() > suffix.size() && name.substr(name.size() - suffix.size()) == suffix)
+                    changed.emplace(name.substr(0, name.size() - suffix.size()));
+            }
+        }
+
+        // Nobody cares about the entries nobody asked for
+        for (const auto& app_id : changed) {
+            auto it = self->entries.find(app_id);
+            if (it == self->entries.end()) continue;
+            it->second = self->load(app_id);
+            LOGD("shader-dock: desktop entry of ", app_id, " changed");
+            desktop_entry_changed_signal ev{app_id};
+            self->emit(&ev);
+        }
+        return 0;
+    }
+};
+
+// Emitted on RunningApps when the number of views of an app changed
+struct running_apps_changed_signal
+{
+    std::string app_id;  // as app_key() has it
+};
+
+/** App ids of views and desktop ids differ in case only too often: "Firefox". */
+static std::string app_key(std::string app_id)
+{
+    std::transform(app_id.begin(), app_id.end(), app_id.begin(),
+                   [] (unsigned char c) { return std::tolower(c); });
+    return app_id;
+}
+
+/**
+ * The mapped toplevel views of each app, shared by all outputs. Kept up to
+ * date from view signals, so that neither counting nor focusing an app
+ * walks the view list.
+ */
+class RunningApps : public wf::custom_data_t, public wf::signal::provider_t
+{
+  public:
+    RunningApps()
+    {
+        for (auto& view : wf::get_core().get_all_views())
+            if (view->is_mapped()) add(view);
+        wf::get_core().connect(&on_view_mapped);
+        wf::get_core().connect(&on_view_unmapped);
+        wf::get_core().connect(&on_app_id_changed);
+    }
+
+    size_t count(const std::string& key) const
+    {
+        auto it = views.find(key);
+        return it == views.end() ? 0 : it->second.size();
+    }
+
+    /**
+     * The view of app @key to focus when @current is focused: the most
+     * recently mapped one, or the one before @current to cycle through
+     * them. nullptr if the app has no views.
+     */
+    wayfire_toplevel_view next_view(const std::string& key, wayfire_view current) const
+    {
+        auto it = views.find(key);
+        if (it == views.end() || it->second.empty()) return nullptr;
+
+        const auto& list = it->second;
+        auto pos = std::find_if(list.begin(), list.end(),
+                                [&] (const wayfire_toplevel_view& view) { return view.get() == current.get(); });
+        if (pos == list.end() || pos == list.begin()) return list.back();
+        return *(pos - 1);
+    }
+
+  private:
+    std::unordered_map<std::string, std::vector<wayfire_toplevel_view>> views;
+    // The key a view was counted under, which an app id change leaves behind
+    std::unordered_map<wf::view_interface_t*, std::string> keys;
+
+    void add(wayfire_view view)
+    {
+        auto toplevel = wf::toplevel_cast(view);
+        if (!toplevel || toplevel->parent || keys.count(view.get())) return;
+
+        std::string key = app_key(view->get_app_id());
+        keys[view.get()] = key;
+        views[key].push_back(toplevel);
+        changed(key);
+    }
+
+    void remove(wayfire_view view)
+    {
+        auto it = keys.find(view.get());
+        if (it == keys.end()) return;
+
+        std::string key = std::move(it->second);
+        keys.erase(it);
+        auto& list = views[key];
+        list.erase(std::find_if(list.begin(), list.end(),
+                                [&] (const wayfire_toplevel_view& v) { return v.get() == view.get(); }));
+        if (list.empty()) views.erase(key);
+        changed(key);
+    }
+
+    void changed(const std::string& key)
+    {
+        running_apps_changed_signal ev;
+        ev.app_id = key;
+        emit(&ev);
+    }
+
+    wf::signal::connection_t<wf::view_mapped_signal> on_view_mapped =
+        [=] (wf::view_mapped_signal *ev) { add(ev->view); };
+
+    wf::signal::connection_t<wf::view_unmapped_signal> on_view_unmapped =
+        [=] (wf::view_unmapped_signal *ev) { remove(ev->view); };
+
+    wf::signal::connection_t<wf::view_app_id_changed_signal> on_app_id_changed =
+        [=] (wf::view_app_id_changed_signal *ev) {
+            auto it = keys.find(ev->view.get());
+            if (it == keys.end() || it->second == app_key(ev->view->get_app_id())) return;
+            remove(ev->view);
+            add(ev->view);
+        };
+};
+
+/**
+ * Starts applications without copying the compositor: posix_spawn() runs
+ * the child on the parent's memory until it execs (glibc uses
+ * clone(CLONE_VM | CLONE_VFORK)). Each child is reaped from the event
+ * loop once its pidfd says it exited, children of kernels without pidfds
+ * by polling.
+ */
+class ProcessLauncher : public wf::custom_data_t
+{
+  public:
+    /**
+     * Start the application of @icon, detached into its own session: its
+     * arguments directly, or its Exec line through the shell if it has one.
+     */
+    void launch(const DockIcon& icon)
+    {
+        if (icon.argv.empty()) {
+            LOGD("shader-dock: launching '", icon.exec, "' through the shell");
+            const char* argv[] = {"sh", "-c", icon.exec.c_str(), nullptr};
+            spawn("/bin/sh", argv, false);
+            return;
+        }
+
+        LOGD("shader-dock: launching '", icon.exec, "'");
+        std::vector<const char*> argv;
+        for (const auto& arg : icon.argv) argv.push_back(arg.c_str());
+        argv.push_back(nullptr);
+        spawn(argv[0], argv.data(), true);
+    }
+
+    /**
+     * Children still running when the last dock goes stay the compositor's:
+     * a child process cannot be handed to another parent, and nothing of
+     * the plugin is left to reap them. Each one that exits after that is
+     * a zombie until the compositor exits. Logged, so that it is not a
+     * surprise.
+     */
+    ~ProcessLauncher()
+    {
+        reap();
+        if (!children.empty())
+            LOGI("shader-dock: unloading with ", children.size(), " launched apps still running, "
+                 "they are left unreaped");
+        for (auto& child : children) {
+            if (child->source) wl_event_source_remove(child->source);
+            if (child->pidfd >= 0) close(child->pidfd);
+        }
+    }
+
+  private:
+    struct Child
+    {
+        ProcessLauncher *launcher;
+        pid_t pid;
+        int pidfd = -1;
+        wl_event_source *source = nullptr;
+    };
+
+    static constexpr uint32_t reap_poll_interval_ms = 1000;
+    // Unreaped children, each waited for through its pidfd if it has one
+    std::vector<std::unique_ptr<Child>> children;
+    wf::wl_timer<true> reap_timer;
+
+    /** Run @path with @argv, looked up in PATH with @search_path. */
+    void spawn(const char* path, const char* const* argv, bool search_path)
+    {
+        posix_spawnattr_t attr;
+        posix_spawnattr_init(&attr);
+        // The compositor blocks and ignores signals of its own, which the
+        // child would otherwise inherit
+        sigset_t signals;
+        sigemptyset(&signals);
+        posix_spawnattr_setsigmask(&attr, &signals);
+        sigfillset(&signals);
+        posix_spawnattr_setsigdefault(&attr, &signals);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        close_inherited(actions);
+
+        pid_t pid;
+        int err = (search_path ? posix_spawnp : posix_spawn)(&pid, path, &actions, &attr,
+                                                             (char* const*)argv, environ);
+        posix_spawn_file_actions_destroy(&actions);
+        posix_spawnattr_destroy(&attr);
+        if (err != 0) {
+            LOGD("shader-dock: spawn failed: ", strerror(err));
+            return;
+        }
+
+        LOGD("shader-dock: spawned process ", pid);
+        watch(pid);
+    }
+
+    /**
+     * Close whatever descriptors the compositor left without O_CLOEXEC in
+     * the child, at any number. Without posix_spawn_file_actions_addclosefrom_np
+     * (glibc 2.34, close_range() in the child) the descriptors open now are
+     * closed one by one; glibc and musl skip those that are gone by then.
+     */
+    static void close_inherited(posix_spawn_file_actions_t& actions)
+    {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 34))
+        posix_spawn_file_actions_addclosefrom_np(&actions, 3);
+#else
+        if (DIR *dir = opendir("/proc/self/fd")) {
+            while (auto *ent = readdir(dir)) {
+                int fd = atoi(ent->d_name);
+                if (fd >= 3 && fd != dirfd(dir)) posix_spawn_file_actions_addclose(&actions, fd);
+            }
+            closedir(dir);
+        } else {
+            // No /proc: the range the dock always closed
+            for (int fd = 3; fd < 256; fd++) posix_spawn_file_actions_addclose(&actions, fd);
+        }
+#endif
+    }
+
+    void watch(pid_t pid)
+    {
+        auto child = std::make_unique<Child>();
+        child->launcher = this;
+        child->pid = pid;
+#ifdef SYS_pidfd_open
+        child->pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+#endif
+        if (child->pidfd >= 0) {
+            child->source = wl_event_loop_add_fd(wf::get_core().ev_loop, child->pidfd,
+                                                 WL_EVENT_READABLE, handle_exit, child.get());
+        } else if (!reap_timer.is_connected()) {
+            reap_timer.set_timeout(reap_poll_interval_ms, [=] () { return reap(); });
+        }
+        children.push_back(std::move(child));
+    }
+
+    /** Reap whichever children exited. Returns whether some are left to poll. */
+    bool reap()
+    {
+        bool polling = false;
+        for (auto it = children.begin(); it != children.end();) {
+            auto& child = **it;
+            if (waitpid(child.pid, nullptr, WNOHANG) == 0) {
+                polling |= !child.source;
+                ++it;
+                continue;
+            }
+            if (child.source) wl_event_source_remove(child.source);
+            if (child.pidfd >= 0) close(child.pidfd);
+            it = children.erase(it);
+        }
+        return polling;
+    }
+
+    static int handle_exit(int, uint32_t, void *data)
+    {
+        auto child = (Child*)data;
+        child->launcher->reap();
+        return 0;
+    }
+};
+
+// ============================================================================
+// Main Plugin
+// ============================================================================
+
+enum class AnimationState
+{
+    Idle,     // nothing moves, no damage and no timer
+    Running,  // frames are scheduled until needs_animation() turns false
+};
+
+// Hover values closer than this to their target are considered settled
+static constexpr float hover_epsilon = 0.002f;
+// Time constant of the exponential hover easing, in seconds. Equivalent to
+// the old fixed 0.2 step per frame at 60 Hz, but independent of refresh rate.
+static constexpr float hover_time_constant = 0.075f;
+// Upper bound for a single animation step, e.g. after a stalled output
+static constexpr float max_frame_delta = 0.1f;
+// Autohide: duration of the slide in or out, and the width of the edge
+// strip that reveals a hidden dock
+static constexpr float slide_duration = 0.2f;
+static constexpr int reveal_hotspot_width = 2;
+
+// The automatic render quality drops to Static when animation frames come
+// in this much slower than the output refreshes, on average over at least
+// frame_budget_samples frames, and tries Full again after the cooldown.
+static constexpr float frame_budget_factor = 1.5f;
+static constexpr int frame_budget_samples = 60;
+static constexpr uint32_t over_budget_cooldown_ms = 60000;
+
+class ShaderDockPlugin;
+
+/**
+ * The dock as a node in its output's TOP layer, in output-local
+ * coordinates. As part of the scene, the compositor clips the dock's
+ * damage against what is in front of it, skips it where it is covered and
+ * can still scan out a fullscreen surface directly when one is above it.
+ */
+class DockNode : public wf::scene::node_t
+{
+  public:
+    DockNode(ShaderDockPlugin *dock) : node_t(false), dock(dock) {}
+
+    void gen_render_instances(std::vector<wf::scene::render_instance_uptr>& instances,
+                              wf::scene::damage_callback push_damage, wf::output_t *shown_on) override;
+    wf::geometry_t get_bounding_box() override;
+
+    std::string stringify() const override
+    {
+        return "shader-dock";
+    }
+
+    ShaderDockPlugin *const dock;
+};
+
+class DockRenderInstance : public wf::scene::render_instance_t
+{
+  public:
+    DockRenderInstance(DockNode *self, wf::scene::damage_callback push_damage) :
+        self(self), push_damage(push_damage)
+    {
+        self->connect(&on_node_damage);
+    }
+
+    void schedule_instructions(std::vector<wf::scene::render_instruction_t>& instructions,
+                               const wf::render_target_t& target, wf::region_t& damage) override
+    {
+        // The dock is translucent, so it leaves the damage for what is below
+        wf::region_t ours = damage & self->get_bounding_box();
+        if (!ours.empty())
+            instructions.push_back(wf::scene::render_instruction_t{
+                .instance = this,
+                .target = target,
+                .damage = std::move(ours),
+            });
+    }
+
+    void render(const wf::render_target_t& target, const wf::region_t& region) override;
+    wf::scene::direct_scanout try_scanout(wf::output_t *output) override;
+    void compute_visibility(wf::output_t *output, wf::region_t& visible) override;
+
+  private:
+    DockNode *self;
+    wf::scene::damage_callback push_damage;
+
+    wf::signal::connection_t<wf::scene::node_damage_signal> on_node_damage =
+        [=] (wf::scene::node_damage_signal *ev) {
+            push_damage(ev->region);
+        };
+};
+
+/** A Wayfire render target as the DockRenderer sees it. */
+class OutputTarget : public DockTarget
+{
+  public:
+    OutputTarget(const wf::render_target_t& target) : target(target)
+    {
+        geometry = target.geometry;
+        scale = target.scale;
+    }
+
+    void bind() const override
+    {
+        target.bind();
+    }
+
+    void scissor(const wlr_box& box) const override
+    {
+        target.logic_scissor(box);
+    }
+
+  private:
+    const wf::render_target_t& target;
+};
+
+class ShaderDockPlugin : public wf::per_output_plugin_instance_t
+{
+    wf::option_wrapper_t<int> opt_icon_size{"shader-dock/icon_size"};
+    wf::option_wrapper_t<int> opt_spacing{"shader-dock/spacing"};
+    wf::option_wrapper_t<int> opt_margin{"shader-dock/margin"};
+    wf::option_wrapper_t<double> opt_corner_radius{"shader-dock/corner_radius"};
+    wf::option_wrapper_t<double> opt_magnification{"shader-dock/magnification"};
+    wf::option_wrapper_t<double> opt_magnification_radius{"shader-dock/magnification_radius"};
+    wf::option_wrapper_t<wf::color_t> opt_bevel_color{"shader-dock/bevel_color"};
+    wf::option_wrapper_t<wf::color_t> opt_background_color{"shader-dock/background_color"};
+    wf::option_wrapper_t<std::string> opt_apps{"shader-dock/apps"};
+    wf::option_wrapper_t<bool> opt_shimmer{"shader-dock/shimmer"};
+    wf::option_wrapper_t<bool> opt_hue_border{"shader-dock/hue_border"};
+    wf::option_wrapper_t<bool> opt_autohide{"shader-dock/autohide"};
+    wf::option_wrapper_t<int> opt_autohide_unload_delay{"shader-dock/autohide_unload_delay"};
+    wf::option_wrapper_t<std::string> opt_quality{"shader-dock/quality"};
+    wf::option_wrapper_t<int> opt_stats_interval{"shader-dock/stats_interval"};
+    wf::option_wrapper_t<bool> opt_stats_overlay{"shader-dock/stats_overlay"};
+
+    std::vector<DockIcon> icons;
+    // GL resources, those of the renderer that draws the frames
+    wf::shared_data::ref_ptr_t<PerRenderer<DockPrograms>> renderer_programs;
+    wf::shared_data::ref_ptr_t<PerRenderer<SharedIconAtlas>> renderer_atlases;
+    wlr_renderer *device = nullptr;
+    DockPrograms *programs = nullptr;
+    SharedIconAtlas *shared_atlas = nullptr;
+    wf::shared_data::ref_ptr_t<IconThemeIndex> theme_index;
+    wf::shared_data::ref_ptr_t<ProcessLauncher> launcher;
+    wf::shared_data::ref_ptr_t<DesktopDatabase> desktop_db;
+    std::vector<std::string> app_ids;  // as configured, installed or not
+    wf::shared_data::ref_ptr_t<RunningApps> running_apps;
+    std::unordered_map<std::string, size_t> icon_index;  // app_key() to index in icons
+    DockRenderer renderer;
+    std::vector<wlr_box> damage_boxes;  // of the frame being rendered
+    bool gl_initialized = false;
+
+    // Docks on outputs other than the active one at startup skip their
+    // icons and GL resources in init(), and set them up once first visible
+    bool setup_deferred = false;
+    wf::wl_idle_call idle_setup;
+
+    std::shared_ptr<DockNode> node;
+    wf::geometry_t dock_geometry{0, 0, 0, 0};  // output-local, like the node
+    wf::geometry_t base_geometry{0, 0, 0, 0};  // dock_geometry when not slid away
+    int icon_size = 64, spacing = 8, margin = 8;
+    // Docks taller than the output show a window onto their icons, which
+    // scrolls: content_height is all of them, scroll_offset how far the
+    // window moved down from the first slot.
+    int content_height = 0;
+    int scroll_offset = 0;
+    float corner_radius = 12.0f;
+    // Icons near the pointer grow up to magnification times, over
+    // magnification_radius icons to each side. The lens fades in and out
+    // with lens_progress as the pointer enters and leaves the dock.
+    float magnification = 1.0f;
+    float magnification_radius = 2.5f;
+    float lens_focus = 0.0f;
+    float lens_progress = 0.0f;
+    glm::vec4 bevel_color{0.8f, 0.7f, 0.5f, 0.6f};
+    glm::vec4 bg_color{0.1f, 0.1f, 0.1f, 0.85f};
+
+    // Animation clock, only advances while the dock is Running so that
+    // continuous effects resume where they stopped instead of jumping
+    float anim_time = 0.0f;
+    std::chrono::steady_clock::time_point last_frame_time;
+    AnimationState anim_state = AnimationState::Idle;
+    bool pointer_over_dock = false;
+    bool occluded = false;
+    int hovered_icon = -1;
+    // Icons whose hover value is still off its target, so that a frame
+    // only steps those and not the whole dock
+    std::vector<int> easing_icons;
+
+    // Autohide: how far the dock has slid off the edge, from 0 (shown) to
+    // 1 (hidden). A hidden dock has its node disabled.
+    float hide_progress = 0.0f;
+    bool covered_by_view = false;
+    wf::wl_timer<false> unload_timer;
+
+    // Render quality, as configured or, in auto mode, as the power source
+    // and the frame rate allow
+    RenderQuality quality = RenderQuality::Full;
+    wf::shared_data::ref_ptr_t<PowerMonitor> power;
+    bool watching_power = false;
+    bool over_budget = false;
+    wf::wl_timer<false> budget_timer;
+    float frame_interval_avg = 0.0f;
+    int frame_samples = 0;
+
+    // Frame costs, only measured while the stats log or overlay is on
+    RollingStat gpu_background_ms, gpu_icons_ms, gpu_total_ms;
+    RollingStat cpu_render_ms, cpu_pre_hook_ms, draw_calls, shaded_pixels;
+    wf::wl_timer<true> stats_timer;
+
+    wf::signal::connection_t<wf::output_configuration_changed_signal> on_output_changed =
+        [=] (wf::output_configuration_changed_signal*) {
+            wf::scene::damage_node(node, dock_extent());
+            update_geometry();
+            // A new scale needs icons scaled to the new pixel size
+            resolve_icons();
+            wf::scene::damage_node(node, dock_extent());
+        };
+
+    // Pointer button signal connection
+    wf::signal::connection_t<wf::post_input_event_signal<wlr_pointer_button_event>> on_button =
+        [=] (wf::post_input_event_signal<wlr_pointer_button_event> *ev) {
+            handle_button(ev->event);
+        };
+
+    // A background decode finished, the icon can be uploaded on the next frame
+    wf::signal::connection_t<icon_decoded_signal> on_icon_decoded =
+        [=] (icon_decoded_signal *ev) {
+            for (size_t i = 0; i < icons.size(); i++)
+                if (icons[i].state == IconState::Loading && icons[i].icon_path == ev->path)
+                    damage_icon(i);
+        };
+
+    wf::signal::connection_t<wf::post_input_event_signal<wlr_pointer_axis_event>> on_axis =
+        [=] (wf::post_input_event_signal<wlr_pointer_axis_event> *ev) {
+            handle_axis(ev->event);
+        };
+
+    wf::signal::connection_t<wf::post_input_event_signal<wlr_pointer_motion_event>> on_motion =
+        [=] (wf::post_input_event_signal<wlr_pointer_motion_event>*) {
+            handle_motion();
+        };
+
+    wf::signal::connection_t<wf::post_input_event_signal<wlr_pointer_motion_absolute_event>> on_motion_absolute =
+        [=] (wf::post_input_event_signal<wlr_pointer_motion_absolute_event>*) {
+            handle_motion();
+        };
+
+    // Anything that can make a fullscreen or maximized view cover the dock
+    wf::signal::connection_t<wf::view_fullscreen_signal> on_view_fullscreen =
+        [=] (wf::view_fullscreen_signal*) { update_covered(); };
+    wf::signal::connection_t<wf::view_tiled_signal> on_view_tiled =
+        [=] (wf::view_tiled_signal*) { update_covered(); };
+    wf::signal::connection_t<wf::view_minimized_signal> on_view_minimized =
+        [=] (wf::view_minimized_signal*) { update_covered(); };
+    wf::signal::connection_t<wf::view_mapped_signal> on_view_mapped =
+        [=] (wf::view_mapped_signal*) { update_covered(); };
+    wf::signal::connection_t<wf::view_unmapped_signal> on_view_unmapped =
+        [=] (wf::view_unmapped_signal*) { update_covered(); };
+    wf::signal::connection_t<wf::workspace_changed_signal> on_workspace_changed =
+        [=] (wf::workspace_changed_signal*) { update_covered(); };
+
+    // Package installs and updates: only the changed app is read again
+    wf::signal::connection_t<desktop_entry_changed_signal> on_desktop_entry_changed =
+        [=] (desktop_entry_changed_signal *ev) {
+            if (std::find(app_ids.begin(), app_ids.end(), ev->app_id) == app_ids.end()) return;
+            wf::scene::damage_node(node, dock_extent());
+            rebuild_icons(ev->app_id);
+            update_geometry();
+            wf::scene::damage_node(node, dock_extent());
+        };
+
+    wf::signal::connection_t<running_apps_changed_signal> on_running_apps_changed =
+        [=] (running_apps_changed_signal *ev) {
+            auto it = icon_index.find(ev->app_id);
+            if (it == icon_index.end()) return;
+            auto& icon = icons[it->second];
+            int running = running_apps->count(ev->app_id);
+            if ((icon.running > 0) != (running > 0)) redraw_dock();
+            icon.running = running;
+        };
+
+    wf::signal::connection_t<power_source_changed_signal> on_power_changed =
+        [=] (power_source_changed_signal*) { update_quality(); };
+
+  public:
+    void init() override
+    {
+        auto start = std::chrono::steady_clock::now();
+        device = wf::get_core().renderer;
+        programs = &renderer_programs->acquire(device);
+        shared_atlas = &renderer_atlases->acquire(device);
+        auto active = wf::get_core().seat->get_active_output();
+        setup_deferred = active && active != output;
+
+        read_layout_options();
+        read_colors();
+        read_apps();
+        rebuild_icons();
+        float icons_ms = elapsed_ms(start);
+        desktop_db->connect(&on_desktop_entry_changed);
+        running_apps->connect(&on_running_apps_changed);
+
+        update_geometry();
+
+        node = std::make_shared<DockNode>(this);
+        wf::scene::add_front(output->node_for_layer(wf::scene::layer::TOP), node);
+        output->connect(&on_output_changed);
+        
+        // Connect to pointer button events
+        wf::get_core().connect(&on_button);
+        wf::get_core().connect(&on_axis);
+        wf::get_core().connect(&on_motion);
+        wf::get_core().connect(&on_motion_absolute);
+        shared_atlas->connect(&on_icon_decoded);
+
+        opt_shimmer.set_callback([=] () { wake_animation(); });
+        opt_hue_border.set_callback([=] () { wake_animation(); });
+
+        // Option changes apply to what is there, the GL resources stay
+        opt_bevel_color.set_callback([=] () { read_colors(); redraw_dock(); });
+        opt_background_color.set_callback([=] () { read_colors(); redraw_dock(); });
+        opt_corner_radius.set_callback([=] () { read_layout_options(); redraw_dock(); });
+        opt_spacing.set_callback([=] () { relayout(); });
+        opt_margin.set_callback([=] () { relayout(); });
+        opt_icon_size.set_callback([=] () { relayout(); });
+        opt_magnification.set_callback([=] () { relayout(); });
+        opt_magnification_radius.set_callback([=] () { relayout(); });
+        opt_apps.set_callback([=] () {
+            read_apps();
+            wf::scene::damage_node(node, dock_extent());
+            rebuild_icons();
+            update_geometry();
+            redraw_dock();
+        });
+
+        output->connect(&on_view_fullscreen);
+        output->connect(&on_view_tiled);
+        output->connect(&on_view_minimized);
+        output->connect(&on_view_mapped);
+        output->connect(&on_view_unmapped);
+        output->connect(&on_workspace_changed);
+        opt_autohide.set_callback([=] () { update_covered(); });
+        update_covered();
+
+        power->connect(&on_power_changed);
+        opt_quality.set_callback([=] () { update_quality(); });
+        quality = choose_quality();
+
+        opt_stats_interval.set_callback([=] () { update_stats(); });
+        opt_stats_overlay.set_callback([=] () {
+            wf::scene::damage_node(node, stats_overlay_rect());
+            update_stats();
+        });
+        update_stats();
+
+        wf::scene::damage_node(node, dock_extent());
+        if (needs_animation())
+            wake_animation();
+
+        if (setup_deferred) {
+            LOGI("shader-dock: ", output->to_string(), " initialized in ", elapsed_ms(start),
+                 " ms, setup deferred until the dock is visible");
+            return;
+        }
+
+        // Shaders compile and decodes run before the first frame asks for them
+        OpenGL::render_begin();
+        init_gl();
+        OpenGL::render_end();
+        LOGI("shader-dock: ", output->to_string(), " initialized with ", icons.size(), " icons in ",
+             elapsed_ms(start), " ms, ", icons_ms, " ms of it for the icons");
+    }
+
+    /** What init() skipped on a deferred dock, run after its first visible frame. */
+    void finish_setup()
+    {
+        auto start = std::chrono::steady_clock::now();
+        setup_deferred = false;
+        wf::scene::damage_node(node, dock_extent());
+        rebuild_icons();
+        update_geometry();
+        redraw_dock();
+        LOGI("shader-dock: ", output->to_string(), " finished its deferred setup with ", icons.size(),
+             " icons in ", elapsed_ms(start), " ms");
+    }
+
+    /** Icon size, spacing, margin, corner radius and magnification, with sensible minimums. */
+    void read_layout_options()
+    {
+        icon_size = opt_icon_size;
+        spacing = opt_spacing;
+        margin = opt_margin;
+        corner_radius = opt_corner_radius;
+        magnification = opt_magnification;
+        magnification_radius = opt_magnification_radius;
+
+        if (icon_size <= 0) icon_size = 64;
+        if (spacing < 0) spacing = 8;
+        if (margin < 0) margin = 8;
+        if (corner_radius < 0) corner_radius = 12.0f;
+        magnification = std::clamp(magnification, 1.0f, 1.0f + max_lens_strength);
+        if (magnification_radius < 1.0f) magnification_radius = 1.0f;
+
+        LOGD("shader-dock: icon_size=", icon_size, " spacing=", spacing, " margin=", margin);
+    }
+
+    void read_colors()
+    {
+        wf::color_t bc = opt_bevel_color;
+        bevel_color = glm::vec4(bc.r, bc.g, bc.b, bc.a);
+        wf::color_t bgc = opt_background_color;
+        bg_color = glm::vec4(bgc.r, bgc.g, bgc.b, bgc.a);
+    }
+
+    void read_apps()
+    {
+        std::string apps_str = opt_apps;
+        LOGD("shader-dock: apps = '", apps_str, "'");
+
+        app_ids.clear();
+        std::istringstream iss(apps_str);
+        for (std::string app; iss >> app;)
+            app_ids.push_back(app);
+    }
+
+    /** Draw the dock again with new uniforms. The bevel mask follows the radius. */
+    void redraw_dock()
+    {
+        renderer.invalidate_cache();
+        wf::scene::damage_node(node, dock_extent());
+    }
+
+    /**
+     * Apply new layout options. A new icon size resolves the theme icons
+     * again and scales them from the cached sources.
+     */
+    void relayout()
+    {
+        wf::scene::damage_node(node, dock_extent());
+        read_layout_options();
+        resolve_icons();
+        update_geometry();
+        redraw_dock();
+    }
+
+    /** Point every icon at the theme image and atlas copy for the current pixel size. */
+    void resolve_icons()
+    {
+        int size = icon_texture_size();
+        // The context is made current once, for all the icons to let go
+        bool gl_current = false;
+        for (auto& icon : icons) {
+            if (icon.state != IconState::Unloaded && icon.texture_size == size) continue;
+            std::string path = theme_index->lookup(icon.icon_name, size);
+            if (path.empty() || path == icon.icon_path) continue;
+
+            if (icon.state != IconState::Unloaded) {
+                if (!gl_current) OpenGL::render_begin();
+                gl_current = true;
+                shared_atlas->release(icon.icon_path, icon.texture_size);
+                icon.state = IconState::Unloaded;
+            }
+            icon.icon_path = path;
+        }
+        if (gl_current) OpenGL::render_end();
+        if (gl_initialized) reload_icons();
+    }
+
+    /** The cursor in output-local coordinates, which the dock uses. */
+    wf::pointf_t local_cursor() const
+    {
+        auto cursor = wf::get_core().get_cursor_position();
+        auto og = output->get_layout_geometry();
+        return {cursor.x - og.x, cursor.y - og.y};
+    }
+
+    void handle_button(wlr_pointer_button_event *event)
+    {
+        auto cursor = local_cursor();
+        
+        LOGD("shader-dock: button event - button=", event->button, 
+             " state=", event->state, " cursor=(", cursor.x, ",", cursor.y, ")");
+        
+        // Only handle left click release
+        if (event->button != BTN_LEFT || event->state != WLR_BUTTON_RELEASED) {
+            return;
+        }
+        
+        int clicked = get_icon_at(cursor.x, cursor.y);
+        LOGD("shader-dock: left click release, icon index=", clicked);
+        
+        if (clicked >= 0 && clicked < (int)icons.size()) {
+            activate_icon(icons[clicked]);
+        }
+    }
+
+    /** Focus a running view of @icon's app, cycling on repeated clicks, or start it. */
+    void activate_icon(const DockIcon& icon)
+    {
+        auto view = running_apps->next_view(app_key(icon.app_id), wf::get_core().seat->get_active_view());
+        if (!view) {
+            launcher->launch(icon);
+            return;
+        }
+
+        LOGD("shader-dock: focusing ", icon.app_id);
+        if (view->minimized) wf::get_core().default_wm->minimize_request(view, false);
+        wf::get_core().default_wm->focus_raise_view(view, true);
+    }
+
+    /** Scroll a dock that does not fit, with the pointer over it. */
+    void handle_axis(wlr_pointer_axis_event *event)
+    {
+        if (event->orientation != WLR_AXIS_ORIENTATION_VERTICAL || content_height <= base_geometry.height)
+            return;
+
+        auto cursor = local_cursor();
+        if (cursor.x < dock_geometry.x || cursor.x >= dock_geometry.x + dock_geometry.width ||
+            cursor.y < dock_geometry.y || cursor.y >= dock_geometry.y + dock_geometry.height)
+            return;
+        scroll_to(scroll_offset + (int)std::lround(event->delta));
+    }
+
+    void scroll_to(int offset)
+    {
+        offset = std::clamp(offset, 0, content_height - base_geometry.height);
+        if (offset == scroll_offset) return;
+
+        scroll_offset = offset;
+        // Icons coming into reach start loading
+        if (gl_initialized && node->is_enabled()) reload_icons();
+        if (update_hovered_icon()) wake_animation();
+        redraw_dock();
+    }
+
+    void handle_motion()
+    {
+        auto cursor = local_cursor();
+        bool inside = cursor.x >= dock_geometry.x && cursor.x < dock_geometry.x + dock_geometry.width &&
+                      cursor.y >= dock_geometry.y && cursor.y < dock_geometry.y + dock_geometry.height;
+        // Grown icons reach out of the dock, and keep the pointer in it
+        if (lens_progress > 0.0f && get_icon_at(cursor.x, cursor.y) >= 0)
+            inside = true;
+        // A dock that is slid away comes back from the edge of the output
+        if (opt_autohide && (hide_progress > 0.0f || pointer_over_dock) &&
+            pointer_calls_dock(base_geometry, cursor.x, cursor.y, pointer_over_dock, reveal_hotspot_width))
+            inside = true;
+        if (inside) move_lens(cursor.y);
+
+        // Only crossing the dock or an icon boundary changes anything
+        bool icon_changed = update_hovered_icon();
+        if (inside == pointer_over_dock && !icon_changed) return;
+
+        // Entering wakes the dock up, leaving lets the hover ease back out
+        if (inside != pointer_over_dock) {
+            pointer_over_dock = inside;
+            update_autohide();
+        }
+        wake_animation();
+    }
+
+    /** The magnification lens as it is now, see DockLens. */
+    DockLens lens() const
+    {
+        return {lens_focus, (magnification - 1.0f) * lens_progress, magnification_radius * (icon_size + spacing)};
+    }
+
+    /** Where lens_progress heads: the lens is up while the pointer is over the dock. */
+    float lens_target() const
+    {
+        return magnification > 1.0f && pointer_over_dock ? 1.0f : 0.0f;
+    }
+
+    /**
+     * Center the lens on @focus. Only what it covers before and after
+     * changes, however many icons the dock has.
+     */
+    void move_lens(float focus)
+    {
+        if (focus == lens_focus) return;
+        if (lens_progress > 0.0f) wf::scene::damage_node(node, layout().lens_bounds(lens()));
+        lens_focus = focus;
+        if (lens_progress > 0.0f) wf::scene::damage_node(node, layout().lens_bounds(lens()));
+    }
+
+    /**
+     * Pick the icon under the pointer, after it moved or the dock did.
+     * Returns whether that is a different one now.
+     */
+    bool update_hovered_icon()
+    {
+        auto cursor = local_cursor();
+        int icon = get_icon_at(cursor.x, cursor.y);
+        if (icon == hovered_icon) return false;
+        ease_icon(hovered_icon);
+        ease_icon(icon);
+        hovered_icon = icon;
+        return true;
+    }
+
+    /** Have the animation step icon @i until its hover settles, see easing_icons. */
+    void ease_icon(int i)
+    {
+        if (i >= 0 && std::find(easing_icons.begin(), easing_icons.end(), i) == easing_icons.end())
+            easing_icons.push_back(i);
+    }
+
+    /** Whether a fullscreen or maximized view on this output overlaps the dock. */
+    bool view_covers_dock()
+    {
+        uint32_t flags = wf::WSET_CURRENT_WORKSPACE | wf::WSET_MAPPED_ONLY | wf::WSET_EXCLUDE_MINIMIZED;
+        for (auto& view : output->wset()->get_views(flags)) {
+            if (!view->pending_fullscreen() && view->pending_tiled_edges() != wf::TILED_EDGES_ALL)
+                continue;
+            auto overlap = wf::geometry_intersection(view->get_geometry(), base_geometry);
+            if (overlap.width > 0 && overlap.height > 0) return true;
+        }
+        return false;
+    }
+
+    void update_covered()
+    {
+        covered_by_view = opt_autohide && view_covers_dock();
+        update_autohide();
+    }
+
+    bool should_hide() const
+    {
+        return opt_autohide && covered_by_view && !pointer_over_dock;
+    }
+
+    /** Start sliding towards the state should_hide() asks for. */
+    void update_autohide()
+    {
+        bool hide = should_hide();
+        if (!hide && !node->is_enabled()) {
+            // Revealing: back into the scene, with the icons it may have let go
+            unload_timer.disconnect();
+            wf::scene::set_node_enabled(node, true);
+            if (gl_initialized) reload_icons();
+        }
+
+        if (hide && occluded && hide_progress < 1.0f) {
+            // Nobody can see the slide
+            hide_progress = 1.0f;
+            apply_slide();
+            finish_hiding();
+            return;
+        }
+
+        if (hide_progress != (hide ? 1.0f : 0.0f))
+            wake_animation();
+    }
+
+    /**
+     * The dock is out of sight: take it out of the scene, so that it draws,
+     * damages and schedules nothing, and give up its icons after a while.
+     */
+    void finish_hiding()
+    {
+        wf::scene::set_node_enabled(node, false);
+        int delay = opt_autohide_unload_delay;
+        if (delay > 0)
+            unload_timer.set_timeout(delay * 1000, [=] () { unload_icons(); });
+    }
+
+    /** Release all icons, reload_icons() brings them back from the icon cache. */
+    void unload_icons()
+    {
+        OpenGL::render_begin();
+        for (auto& icon : icons) {
+            if (icon.state == IconState::Unloaded) continue;
+            shared_atlas->release(icon.icon_path, icon.texture_size);
+            icon.state = IconState::Unloaded;
+        }
+        renderer.release_cache();
+        OpenGL::render_end();
+        LOGD("shader-dock: hidden, icons unloaded");
+    }
+
+    /**
+     * True while something on the dock still changes from frame to frame:
+     * a continuous effect, the pointer hovering the dock, or a hover value
+     * that has not settled on its target yet. Nothing does while the dock
+     * is covered.
+     */
+    bool needs_animation() const
+    {
+        if (hide_progress != (should_hide() ? 1.0f : 0.0f)) return true;
+        if (occluded || hide_progress >= 1.0f) return false;
+        if (shimmer_animates() || border_animates()) return true;
+        if (quality == RenderQuality::Full && pointer_over_dock) return true;
+        if (lens_progress != lens_target()) return true;
+        return !easing_icons.empty();
+    }
+
+    /**
+     * Start driving the animation from the output's frames. The pre hook
+     * stays registered, and keeps requesting the next frame, only while
+     * the dock is Running.
+     */
+    void wake_animation()
+    {
+        if (anim_state == AnimationState::Running) return;
+
+        anim_state = AnimationState::Running;
+        last_frame_time = std::chrono::steady_clock::now();
+        frame_samples = 0;
+        output->render->add_effect(&pre_hook, wf::OUTPUT_EFFECT_PRE);
+        output->render->schedule_redraw();
+    }
+
+    void stop_animation()
+    {
+        if (anim_state == AnimationState::Idle) return;
+
+        anim_state = AnimationState::Idle;
+        output->render->rem_effect(&pre_hook);
+    }
+
+    /**
+     * Advance the animation and damage only what changed: icons whose hover
+     * moved or which are bouncing (the bounce depends on time), every icon
+     * while the shimmer runs, and the whole dock while the border hue cycles.
+     */
+    void step_animation(float dt)
+    {
+        anim_time += dt;
+
+        float hide_target = should_hide() ? 1.0f : 0.0f;
+        if (hide_progress != hide_target) {
+            wf::scene::damage_node(node, dock_extent());
+            float step = dt / slide_duration;
+            hide_progress = hide_target > hide_progress ?
+                std::min(hide_target, hide_progress + step) : std::max(hide_target, hide_progress - step);
+            apply_slide();
+            wf::scene::damage_node(node, dock_extent());
+            if (hide_progress >= 1.0f) {
+                finish_hiding();
+                return;
+            }
+        }
+
+        float ease = 1.0f - std::exp(-dt / hover_time_constant);
+        float lens_to = lens_target();
+        if (lens_progress != lens_to) {
+            wf::scene::damage_node(node, layout().lens_bounds(lens()));
+            lens_progress += (lens_to - lens_progress) * ease;
+            if (std::abs(lens_to - lens_progress) <= hover_epsilon) lens_progress = lens_to;
+            wf::scene::damage_node(node, layout().lens_bounds(lens()));
+            // The icons grew or shrank under the pointer
+            update_hovered_icon();
+        }
+
+        // Only the easing icons move, settling exactly on their targets
+        for (size_t k = 0; k < easing_icons.size();) {
+            int i = easing_icons[k];
+            if (i >= (int)icons.size()) {
+                easing_icons.erase(easing_icons.begin() + k);
+                continue;
+            }
+            float target = hovered_icon == i ? 1.0f : 0.0f;
+            icons[i].hover += (target - icons[i].hover) * ease;
+            bool settled = std::abs(target - icons[i].hover) <= hover_epsilon;
+            if (settled) icons[i].hover = target;
+            damage_icon(i);
+            if (settled) easing_icons.erase(easing_icons.begin() + k);
+            else k++;
+        }
+        if (shimmer_animates()) {
+            for (size_t i = 0; i < icons.size(); i++) damage_icon(i);
+        } else if (quality == RenderQuality::Full && hovered_icon >= 0 && hovered_icon < (int)icons.size()) {
+            // The bounce of the hovered icon keeps going
+            damage_icon(hovered_icon);
+        }
+
+        if (border_animates())
+            wf::scene::damage_node(node, dock_extent());
+    }
+
+    wf::effect_hook_t pre_hook = [=] () {
+        auto start = std::chrono::steady_clock::now();
+        animation_frame();
+        if (stats_enabled())
+            cpu_pre_hook_ms.push(elapsed_ms(start));
+    };
+
+    /** One frame of the animation, from the pre hook. */
+    void animation_frame()
+    {
+        // Damage added in the pre hook lands in the frame being painted
+        auto now = std::chrono::steady_clock::now();
+        float dt = std::chrono::duration<float>(now - last_frame_time).count();
+        last_frame_time = now;
+
+        step_animation(std::min(dt, max_frame_delta));
+        track_frame_budget(dt);
+
+        if (needs_animation()) {
+            output->render->schedule_redraw();
+            return;
+        }
+        stop_animation();
+    }
+
+    bool stats_enabled() const
+    {
+        return opt_stats_interval > 0 || opt_stats_overlay;
+    }
+
+    /** Follow the stats options: the log timer, and the overlay in the node bounds. */
+    void update_stats()
+    {
+        stats_timer.disconnect();
+        int interval = opt_stats_interval;
+        if (interval > 0) {
+            stats_timer.set_timeout(interval * 1000, [=] () {
+                log_stats();
+                return true;
+            });
+        }
+
+        if (opt_stats_overlay) wf::scene::damage_node(node, stats_overlay_rect());
+    }
+
+    void log_stats()
+    {
+        auto percentiles = [] (const RollingStat& stat, int precision) {
+            char text[64];
+            snprintf(text, sizeof(text), "%.*f/%.*f/%.*f", precision, stat.percentile(0.5f),
+                     precision, stat.percentile(0.95f), precision, stat.percentile(0.99f));
+            return std::string(text);
+        };
+        LOGI("shader-dock: ", output->to_string(), " p50/p95/p99 of the last ", RollingStat::window,
+             " frames: GPU background ", percentiles(gpu_background_ms, 3), " ms, icons ", percentiles(gpu_icons_ms, 3),
+             " ms; CPU render ", percentiles(cpu_render_ms, 3), " ms, animation ", percentiles(cpu_pre_hook_ms, 3),
+             " ms; ", percentiles(draw_calls, 0), " draw calls, ", percentiles(shaded_pixels, 0), " pixels");
+    }
+
+    /** Right of the dock and its grown icons, top-aligned with it. */
+    wf::geometry_t stats_overlay_rect() const
+    {
+        auto extent = dock_extent();
+        return {extent.x + extent.width + margin, extent.y, 2 * stats_overlay_samples, 48};
+    }
+
+    /** Draw the frame cost overlay: GPU time of the last frames against the refresh interval. */
+    void draw_stats_overlay(const DockScene& scene, const DockTarget& target, const std::vector<wlr_box>& damage)
+    {
+        auto program = programs->stats();
+        if (!program) return;
 
-        if (vao) glDeleteVertexArrays(1, &vao);
-        if (vbo) glDeleteBuffers(1, &vbo);
-        if (ebo) glDeleteBuffers(1, &ebo);
-        icon_shader.destroy();
-        bg_shader.destroy();
+        float samples[stats_overlay_samples];
+        gpu_total_ms.recent(samples, stats_overlay_samples);
+        int refresh = output->handle->refresh > 0 ? output->handle->refresh : 60000;
+        float full_ms = 1e6f / refresh * stats_overlay_scale;
+        for (auto& sample : samples) sample /= full_ms;
 
-        output->render->damage(dock_geometry);
+        glUseProgram(program->program);
+        glUniform1fv(program->u_samples, stats_overlay_samples, samples);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        renderer.draw_overlay(*program, scene, target, damage, stats_overlay_rect());
+    }
+
+    /** Take in the GPU times the pass timer has ready. Returns whether there were any. */
+    bool collect_gpu_times()
+    {
+        bool collected = false;
+        renderer.pass_timer.collect([&] (const float *ms) {
+            gpu_background_ms.push(ms[PassTimer::Background]);
+            gpu_icons_ms.push(ms[PassTimer::Icons]);
+            gpu_total_ms.push(ms[PassTimer::Background] + ms[PassTimer::Icons]);
+            collected = true;
+        });
+        return collected;
+    }
+
+    bool shimmer_animates() const
+    {
+        return quality == RenderQuality::Full && opt_shimmer;
+    }
+
+    bool border_animates() const
+    {
+        return quality == RenderQuality::Full && opt_hue_border;
+    }
+
+    RenderQuality choose_quality()
+    {
+        std::string mode = opt_quality;
+        bool automatic = mode != "full" && mode != "static" && mode != "off";
+        if (automatic != watching_power) {
+            if (automatic) power->watch();
+            else power->unwatch();
+            watching_power = automatic;
+        }
+
+        if (mode == "static") return RenderQuality::Static;
+        if (mode == "off") return RenderQuality::Off;
+        if (mode == "full") return RenderQuality::Full;
+        return (power->on_battery || over_budget) ? RenderQuality::Static : RenderQuality::Full;
+    }
+
+    void update_quality()
+    {
+        RenderQuality next = choose_quality();
+        if (next == quality) return;
+
+        LOGD("shader-dock: render quality ", (int)quality, " -> ", (int)next);
+        quality = next;
+        frame_samples = 0;
+        renderer.invalidate_cache();
+        wf::scene::damage_node(node, dock_extent());
+        wake_animation();
+    }
+
+    /**
+     * Average the interval between animation frames of the full quality in
+     * auto mode, and fall back to Static for a while when it takes longer
+     * than the refresh rate allows.
+     */
+    void track_frame_budget(float dt)
+    {
+        if (!watching_power || quality != RenderQuality::Full) return;
+
+        // The first frame after waking up measures the wake up, not a frame
+        if (frame_samples++ == 0) return;
+        frame_interval_avg = frame_samples == 2 ? dt : frame_interval_avg + (dt - frame_interval_avg) * 0.1f;
+        if (frame_samples <= frame_budget_samples) return;
+
+        int refresh = output->handle->refresh > 0 ? output->handle->refresh : 60000;
+        float budget = frame_budget_factor * 1000.0f / refresh;
+        if (frame_interval_avg <= budget) return;
+
+        LOGD("shader-dock: frames take ", frame_interval_avg * 1000.0f, "ms, over the ", budget * 1000.0f, "ms budget");
+        over_budget = true;
+        budget_timer.set_timeout(over_budget_cooldown_ms, [=] () {
+            over_budget = false;
+            update_quality();
+        });
+        update_quality();
+    }
+
+    /** Icon size in physical pixels on this output. */
+    int icon_pixel_size() const
+    {
+        return (int)std::ceil(icon_size * output->handle->scale);
+    }
+
+    /** Pixel size of the atlas copies: that of an icon grown all the way by the lens. */
+    int icon_texture_size() const
+    {
+        return (int)std::ceil(icon_size * magnification * output->handle->scale);
+    }
+
+    /**
+     * Whether icon @i is within a dock height of the visible window, where
+     * it is worth loading. The rest loads as it scrolls closer.
+     */
+    bool icon_in_reach(int i) const
+    {
+        auto rect = get_icon_rect(i);
+        return rect.y + rect.height > dock_geometry.y - dock_geometry.height &&
+            rect.y < dock_geometry.y + 2 * dock_geometry.height;
+    }
+
+    /** Point every icon in reach at an atlas copy of the current pixel size. */
+    void reload_icons()
+    {
+        int size = icon_texture_size();
+        for (auto& icon : icons) {
+            if (icon.icon_path.empty() || (icon.state != IconState::Unloaded && icon.texture_size == size))
+                continue;
+            if (icon.state == IconState::Unloaded && !icon_in_reach(&icon - icons.data()))
+                continue;
+
+            // Acquire first, the atlas goes away with its last icon
+            IconState previous = icon.state;
+            int previous_size = icon.texture_size;
+            icon.texture_size = size;
+            icon.state = shared_atlas->acquire(icon.icon_path, size, icon.atlas_rect);
+            if (previous != IconState::Unloaded)
+                shared_atlas->release(icon.icon_path, previous_size);
+        }
+    }
+
+    /**
+     * Make icons match app_ids again. Apps still there keep their DockIcon,
+     * and with it its image. @stale_app_id has a changed desktop entry and
+     * is read again, but keeps its image too if the icon stayed the same.
+     * The caller updates the geometry.
+     */
+    void rebuild_icons(const std::string& stale_app_id = "")
+    {
+        // finish_setup() builds them, from the app ids current by then
+        if (setup_deferred) return;
+
+        std::vector<DockIcon> old = std::move(icons);
+        icons.clear();
+        for (const auto& app_id : app_ids) {
+            auto reuse = std::find_if(old.begin(), old.end(),
+                                      [&] (const DockIcon& icon) { return icon.app_id == app_id; });
+            if (reuse != old.end() && app_id != stale_app_id) {
+                icons.push_back(std::move(*reuse));
+                reuse->app_id.clear();
+                reuse->state = IconState::Unloaded;
+                continue;
+            }
+
+            DockIcon icon;
+            auto entry = desktop_db->find(app_id);
+            if (!entry || !dock_icon_from_entry(app_id, *entry, icon)) continue;
+            icon.icon_path = theme_index->lookup(icon.icon_name, icon_texture_size());
+            if (icon.icon_path.empty()) continue;
+            if (reuse != old.end() && reuse->icon_path == icon.icon_path) {
+                icon.state = reuse->state;
+                icon.texture_size = reuse->texture_size;
+                icon.atlas_rect = reuse->atlas_rect;
+                icon.hover = reuse->hover;
+                reuse->state = IconState::Unloaded;
+            }
+            if (reuse != old.end()) reuse->app_id.clear();
+            icons.push_back(std::move(icon));
+            LOGD("shader-dock: added ", app_id);
+        }
+
+        icon_index.clear();
+        easing_icons.clear();
+        for (size_t i = 0; i < icons.size(); i++) {
+            std::string key = app_key(icons[i].app_id);
+            icons[i].running = running_apps->count(key);
+            icon_index[key] = i;
+            // Icons kept their hover, and may have moved
+            if (icons[i].hover != (hovered_icon == (int)i ? 1.0f : 0.0f)) ease_icon(i);
+        }
+
+        bool release = std::any_of(old.begin(), old.end(),
+                                   [] (const DockIcon& icon) { return icon.state != IconState::Unloaded; });
+        if (release) {
+            OpenGL::render_begin();
+            for (auto& icon : old)
+                if (icon.state != IconState::Unloaded) shared_atlas->release(icon.icon_path, icon.texture_size);
+            OpenGL::render_end();
+        }
+        if (gl_initialized) reload_icons();
+    }
+
+    void update_geometry()
+    {
+        auto og = output->get_relative_geometry();
+        int n = icons.empty() ? 1 : (int)icons.size();
+        // Vertical layout on left edge
+        int w = icon_size + margin * 2;
+        content_height = n * icon_size + (n > 1 ? (n - 1) * spacing : 0) + margin * 2;
+        int h = std::min(content_height, std::max(og.height - margin * 2, icon_size + margin * 2));
+        scroll_offset = std::clamp(scroll_offset, 0, content_height - h);
+        base_geometry.x = og.x + margin;
+        base_geometry.y = og.y + (og.height - h) / 2;  // Centered vertically
+        base_geometry.width = w;
+        base_geometry.height = h;
+        apply_slide();
+        
+        LOGD("shader-dock: geometry x=", base_geometry.x, " y=", base_geometry.y, 
+             " w=", base_geometry.width, " h=", base_geometry.height,
+             " icons=", n, " icon_size=", icon_size, " spacing=", spacing);
+    }
+
+    /** Move the dock towards the left edge by hide_progress, eased. */
+    void apply_slide()
+    {
+        float t = hide_progress * hide_progress * (3.0f - 2.0f * hide_progress);
+        dock_geometry = base_geometry;
+        dock_geometry.x -= (int)std::lround((base_geometry.x + base_geometry.width) * t);
+
+        // The dock moved under the pointer
+        if (update_hovered_icon()) wake_animation();
+    }
+    /** Where the icons are, see DockLayout. */
+    DockLayout layout() const
+    {
+        return {dock_geometry, (int)icons.size(), icon_size, spacing, margin, scroll_offset};
+    }
+
+    /** On-screen rectangle of icon i, which may be scrolled out of the dock. */
+    wf::geometry_t get_icon_rect(int i) const
+    {
+        return layout().icon_rect(i);
+    }
+
+    /** Everything icon @i can draw to, under the lens too, see get_icon_rect(). */
+    wlr_box get_icon_bounds(int i) const
+    {
+        return layout().magnified_bounds(i, lens());
+    }
+
+    void damage_icon(int i)
+    {
+        wf::scene::damage_node(node, get_icon_bounds(i));
+    }
+
+    /** The icon at @x, @y as the lens shows it, or -1. */
+    int get_icon_at(int x, int y) const
+    {
+        return layout().magnified_icon_at(x, y, lens());
+    }
+
+    /** The dock and, with magnification, what its grown icons reach out to. */
+    wf::geometry_t dock_extent() const
+    {
+        if (magnification <= 1.0f) return dock_geometry;
+        int reach = layout().lens_reach(magnification - 1.0f);
+        return {dock_geometry.x, dock_geometry.y, reach - dock_geometry.x, dock_geometry.height};
+    }
+
+    void init_gl()
+    {
+        if (gl_initialized) return;
+        // Compiled or loaded by the first dock of the renderer to ask, shared by the rest
+        auto start = std::chrono::steady_clock::now();
+        if (!programs->get(quality)) return;
+        float programs_ms = elapsed_ms(start);
+
+        renderer.init(icons.size());
+        easing_icons.reserve(8);
+        // Damage of more boxes grows it once, and it keeps the room after
+        damage_boxes.reserve(32);
+
+        // Decoding happens in the background, icons show up as they finish
+        reload_icons();
+        gl_initialized = true;
+        LOGI("shader-dock: ", output->to_string(), " GL setup took ", elapsed_ms(start), " ms, ",
+             programs_ms, " ms of it for the shaders");
+    }
+
+    /** The dock as it looks now, for the renderer. Needs the GL context for the bevel mask. */
+    DockScene scene()
+    {
+        DockScene scene;
+        scene.layout = layout();
+        scene.icons = icons.data();
+        scene.atlas = &shared_atlas->atlas;
+        scene.bevel_mask = &programs->bevel_mask(icon_pixel_size(), icon_size, corner_radius);
+        scene.lens = lens();
+        scene.corner_radius = corner_radius;
+        scene.bevel_color = bevel_color;
+        scene.background_color = bg_color;
+        scene.time = anim_time;
+        scene.shimmer = shimmer_animates();
+        scene.hue_border = border_animates();
+        return scene;
+    }
+
+    /** The node's bounds: the dock with its grown icons, and the stats overlay while it is on. */
+    wf::geometry_t get_geometry() const
+    {
+        auto extent = dock_extent();
+        if (!opt_stats_overlay) return extent;
+
+        auto overlay = stats_overlay_rect();
+        int x2 = std::max(extent.x + extent.width, overlay.x + overlay.width);
+        int y2 = std::max(extent.y + extent.height, overlay.y + overlay.height);
+        int x1 = std::min(extent.x, overlay.x), y1 = std::min(extent.y, overlay.y);
+        return {x1, y1, x2 - x1, y2 - y1};
+    }
+
+    bool has_content() const
+    {
+        return !icons.empty();
+    }
+
+    /** Draw the part of the dock in @damage, for DockRenderInstance. */
+    void render(const wf::render_target_t& target, const wf::region_t& damage)
+    {
+        if (icons.empty()) return;
+
+        auto start = std::chrono::steady_clock::now();
+        damage_boxes.clear();
+        for (const auto& box : damage) damage_boxes.push_back(wlr_box_from_pixman_box(box));
+        // Frames that only redraw the overlay are none of the dock's cost
+        bool measure = stats_enabled() && std::any_of(damage_boxes.begin(), damage_boxes.end(),
+                                                      [&] (const wlr_box& box) {
+            return box_area(box_intersection(box, dock_geometry)) > 0;
+        });
+        OutputTarget dock_target(target);
+
+        bool collected = false;
+        OpenGL::render_begin(target);
+        init_gl();
+        auto shaders = programs->get(quality);
+        if (gl_initialized && shaders) {
+            if (stats_enabled()) collected = collect_gpu_times();
+            shared_atlas->flush_uploads();
+            for (auto& icon : icons)
+                if (icon.state == IconState::Loading)
+                    icon.state = shared_atlas->lookup(icon.icon_path, icon.texture_size, icon.atlas_rect);
+
+            auto current = scene();
+            renderer.render(*shaders, current, dock_target, damage_boxes, measure);
+            if (opt_stats_overlay) draw_stats_overlay(current, dock_target, damage_boxes);
+        }
+        DockRenderer::reset_gl_state();
+        OpenGL::render_end();
+
+        if (measure) {
+            cpu_render_ms.push(elapsed_ms(start));
+            draw_calls.push(renderer.draw_calls);
+            shaded_pixels.push(renderer.shaded_pixels);
+        }
+        // New results, or more to come: the overlay follows them
+        if (opt_stats_overlay && (collected || renderer.pass_timer.has_pending()))
+            wf::scene::damage_node(node, stats_overlay_rect());
+    }
+
+    /**
+     * Track whether anything of the dock is left uncovered. A covered dock
+     * stops requesting frames, the pre hook notices on its next run. A
+     * deferred dock finishes its setup once uncovered.
+     */
+    void set_occluded(bool covered)
+    {
+        // Not from within the frame, which has already laid out the dock
+        if (!covered && setup_deferred && !idle_setup.is_connected())
+            idle_setup.run_once([=] () { finish_setup(); });
+        if (covered == occluded) return;
+
+        occluded = covered;
+        if (!occluded && needs_animation())
+            wake_animation();
+    }
+
+    void fini() override
+    {
+        stop_animation();
+        on_button.disconnect();
+        on_axis.disconnect();
+        on_motion.disconnect();
+        on_motion_absolute.disconnect();
+        unload_timer.disconnect();
+        on_power_changed.disconnect();
+        on_desktop_entry_changed.disconnect();
+        on_running_apps_changed.disconnect();
+        budget_timer.disconnect();
+        stats_timer.disconnect();
+        idle_setup.disconnect();
+        if (watching_power) power->unwatch();
+
+        on_icon_decoded.disconnect();
+        OpenGL::render_begin();
+        for (auto& icon : icons)
+            if (icon.state != IconState::Unloaded) shared_atlas->release(icon.icon_path, icon.texture_size);
+        renderer.destroy();
+        renderer_atlases->release(device);
+        renderer_programs->release(device);
+        OpenGL::render_end();
+
+        wf::scene::damage_node(node, dock_extent());
+        wf::scene::remove_child(node);
         LOGD("shader-dock: finalized");
     }
 };
 
+void DockNode::gen_render_instances(std::vector<wf::scene::render_instance_uptr>& instances,
+                                    wf::scene::damage_callback push_damage, wf::output_t *shown_on)
+{
+    // The node lives in one output's layer and only draws there
+    if (shown_on != dock->output) return;
+    instances.push_back(std::make_unique<DockRenderInstance>(this, push_damage));
+}
+
+wf::geometry_t DockNode::get_bounding_box()
+{
+    return dock->get_geometry();
+}
+
+void DockRenderInstance::render(const wf::render_target_t& target, const wf::region_t& region)
+{
+    self->dock->render(target, region);
+}
+
+wf::scene::direct_scanout DockRenderInstance::try_scanout(wf::output_t*)
+{
+    // Anything below has to be composited with the dock on top of it
+    return self->dock->has_content() ? wf::scene::direct_scanout::OCCLUSION : wf::scene::direct_scanout::SKIP;
+}
+
+void DockRenderInstance::compute_visibility(wf::output_t*, wf::region_t& visible)
+{
+    // Box by box, an intersected region would be allocated every frame
+    auto bbox = self->get_bounding_box();
+    bool covered = true;
+    for (const auto& box : visible)
+        if (box_area(box_intersection(wlr_box_from_pixman_box(box), bbox)) > 0) covered = false;
+    self->dock->set_occluded(covered);
+}
+
 } // namespace shader_dock
 
 DECLARE_WAYFIRE_PLUGIN(wf::per_output_plugin_t<shader_dock::ShaderDockPlugin>);
@@ -0,0 +1,149 @@
+/**
+ * Shader Dock checks
+ *
+ * Checks of the compositor independent logic in dock-renderer.hpp that
+ * the plugin's behavior hangs on. No GL context needed: each check is
+ * plain computation on its inputs. Prints the checks that fail, and exits
+ * with 1 if any did.
+ *
+ * Usage: dock-test
+ */
+
+#include "dock-renderer.hpp"
+
+#include <cmath>
+#include <cstdio>
+
+namespace
+{
+
+using namespace shader_dock;
+
+int failures = 0;
+
+void check(bool ok, const char *what)
+{
+    if (ok) return;
+    fprintf(stderr, "dock-test: %s\n", what);
+    failures++;
+}
+
+/**
+ * An autohidden dock called back from the output edge, then the pointer
+ * heading from there to the dock: it has to stay out all the way.
+ */
+void check_reveal_strip()
+{
+    constexpr int hotspot = 2;
+    const wlr_box dock = {8, 100, 80, 400};
+
+    check(pointer_calls_dock(dock, 1, 300, false, hotspot), "the edge does not call a hidden dock back");
+    check(!pointer_calls_dock(dock, 5, 300, false, hotspot), "a hidden dock answers beyond the hotspot");
+    check(!pointer_calls_dock(dock, 1, 50, false, hotspot), "a hidden dock answers beside its height");
+
+    bool called = false;
+    for (double x : {1.0, 0.0, 1.0, 3.0, 5.0, 7.0, 12.0, 87.0}) {
+        called = pointer_calls_dock(dock, x, 300, called, hotspot);
+        check(called, "heading from the edge to the dock hides it again");
+    }
+    check(!pointer_calls_dock(dock, 88, 300, true, hotspot), "the pointer past the dock keeps it out");
+    check(!pointer_calls_dock(dock, 4, 99, true, hotspot), "the pointer above the dock keeps it out");
+}
+
+/** Field codes of Exec lines, expanded for a launch without files. */
+void check_exec_fields()
+{
+    DockIcon icon;
+    icon.name = "Terminal";
+    icon.icon_name = "utilities-terminal";
+    std::vector<std::string> argv;
+
+    check(split_exec("term %i -e \"a b\"", icon, "/apps/term.desktop", argv) &&
+          argv == std::vector<std::string>{"term", "--icon", "utilities-terminal", "-e", "a b"},
+          "%i is not --icon with the Icon key");
+    check(split_exec("term %c %k %U", icon, "/apps/term.desktop", argv) &&
+          argv == std::vector<std::string>{"term", "Terminal", "/apps/term.desktop"},
+          "%c %k %U do not expand to the name, the file and nothing");
+
+    icon.icon_name.clear();
+    check(split_exec("term %i", icon, "/apps/term.desktop", argv) && argv == std::vector<std::string>{"term"},
+          "%i without an Icon key is not dropped");
+    check(!split_exec("term | tee log", icon, "/apps/term.desktop", argv), "a pipe does not need a shell");
+}
+
+/**
+ * The strongest lens swept along a dock: the icon at its focus is grown
+ * all the way, the icons keep their order without overlapping, and the
+ * ones beyond the lens stay where they are. See DockLayout::magnify().
+ */
+void check_lens()
+{
+    DockLayout layout;
+    layout.count = 8;
+    layout.dock = {8, 100, 80, layout.count * (layout.icon_size + layout.spacing) + layout.margin};
+    const float pitch = layout.icon_size + layout.spacing;
+    auto center = [&] (int i) {
+        auto rect = layout.icon_rect(i);
+        return rect.y + rect.height * 0.5f;
+    };
+
+    DockLens lens = {center(4), max_lens_strength, 2.5f * pitch};
+    float top, scale;
+    layout.magnify(4, lens, top, scale);
+    float rest = 1.0f - layout.icon_size * 0.5f / lens.radius;
+    check(std::abs(scale - (1.0f + max_lens_strength * rest * rest * rest)) < 1e-4f,
+          "the icon at the focus is not grown all the way");
+    check(std::abs(top + layout.icon_size * scale * 0.5f - lens.focus) < 1e-3f, "the icon at the focus moved");
+
+    // An icon reaching just inside the rim is all but at rest
+    lens.radius = 2.0f * pitch - layout.icon_size * 0.5f + 0.5f;
+    layout.magnify(2, lens, top, scale);
+    check(std::abs(scale - 1.0f) < 1e-3f && std::abs(top - layout.icon_rect(2).y) < 0.1f,
+          "the icons at the rim of the lens do not meet those beyond");
+
+    lens.radius = 2.5f * pitch;
+    layout.magnify(4, lens, top, scale);
+    float focus_top = top;
+    layout.magnify(5, lens, top, scale);
+    int gap = (int)std::floor((top + layout.icon_size * scale + focus_top) * 0.5f);
+    int x = layout.icon_rect(4).x + 1;
+    check(layout.magnified_icon_at(x, (int)lens.focus, lens) == 4, "the icon at the focus is not the one hit");
+    check(top + layout.icon_size * scale < gap && gap < focus_top && layout.magnified_icon_at(x, gap, lens) == -1,
+          "the gap between grown icons hits an icon");
+
+    bool ordered = true, bounded = true, still = true;
+    for (float radius : {1.0f, 2.0f, 2.5f, 8.0f}) {
+        lens.radius = radius * pitch;
+        for (float focus = layout.dock.y; focus < layout.dock.y + layout.dock.height; focus += 1.0f) {
+            lens.focus = focus;
+            int first, last;
+            if (!layout.lens_span(lens, first, last)) {
+                still = false;
+                continue;
+            }
+
+            // Visually top to bottom, see DockLayout::icon_rect()
+            float bottom = -1e9f;
+            for (int i = layout.count - 1; i >= 0; i--) {
+                layout.magnify(i, lens, top, scale);
+                ordered &= top > bottom;
+                bottom = top + layout.icon_size * scale;
+                bounded &= scale >= 1.0f - max_lens_strength * 0.25f - 1e-4f && scale <= 1.0f + max_lens_strength;
+                if (i < first || i > last) still &= scale == 1.0f && top == layout.icon_rect(i).y;
+            }
+        }
+    }
+    check(ordered, "magnified icons overlap");
+    check(bounded, "a magnified icon grows or shrinks past the lens strength");
+    check(still, "an icon beyond the lens moves");
+}
+
+} // namespace
+
+int main()
+{
+    check_reveal_strip();
+    check_exec_fields();
+    check_lens();
+    return failures ? 1 : 0;
+}